@@ -1,5 +1,6 @@
 #include <iostream>         // cout, cerr
 #include <cstdlib>          // EXIT_FAILURE
+#include <cstring>          // strcmp
 #include <GL/glew.h>        // GLEW library
 #include <GLFW/glfw3.h>     // GLFW library
 #define STB_IMAGE_IMPLEMENTATION
@@ -9,9 +10,38 @@
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
 #include "meshes.h"
 #include "camera.h"
+#include "aobaker.h"
+#include "shaderprogram.h"
+#include "scenebuffers.h"
+#include "renderqueue.h"
+#include "meshpool.h"
+#include "multidrawbatcher.h"
+#include "glstate.h"
+#include "simdmath.h"
+#include "culling.h"
+#include "scenegraph.h"
+#include "mathbenchmark.h"
+#include "ecs.h"
+#include "jobsystem.h"
+#include "gputimer.h"
+#include "gbuffer.h"
+#include "lightclusters.h"
+#include "shadowmap.h"
+#include "occlusionbuffer.h"
+#include "occlusionqueries.h"
+#include "texturearray.h"
+#include "dynamicresolution.h"
+#include "commandlist.h"
+#include "triplebuffer.h"
 
 using namespace std; // Standard namespace
 
@@ -40,12 +70,126 @@ namespace
     GLFWwindow* gWindow = nullptr;
     // Shader program
     //GLuint gProgramId;
-    GLuint gCubeProgramId;
-    GLuint gLampProgramId;
+    ShaderProgram gCubeProgram;
+    ShaderProgram gLampProgram;
+    // Position-only program writing depth ahead of the lit pass
+    ShaderProgram gDepthProgram;
+    // Deferred path: surfaces into the G-buffer, then one lighting draw per light
+    ShaderProgram gGBufferProgram;
+    ShaderProgram gLightProgram;
+
+    // Uniform handles of the lighting program
+    struct LightUniforms
+    {
+        GLint uAlbedo;
+        GLint uNormal;
+        GLint uDepth;
+        GLint uInverseViewProjection;
+        GLint uLightPosition;
+        GLint uLightColor;
+        GLint uAmbientStrength;
+        GLint uShadowIndex;
+        GLint uShadowMap0;
+        GLint uShadowMap1;
+        GLint uShadowMatrix0;
+        GLint uShadowMatrix1;
+        GLint uShadowEnabled;
+    } gLightUniforms;
+
+    // Shadows of the two desk lights. Static casters are cached and re-rendered only
+    // when a light or a static object changes; movable ones are drawn every frame.
+    ShadowMap gShadowMaps[2];
+    const GLsizei SHADOW_MAP_SIZE = 2048;
+    const GLuint SHADOW_UNIT = 4; // Desk light i's map is bound to texture unit SHADOW_UNIT + i
+    ShaderProgram gShadowProgram;
+    GLint gShadowViewProjection = -1; // uLightViewProjection of gShadowProgram
+    MultiDrawBatcher gShadowDraw;
+    // Most shadow map renders per frame; invalidated maps past it wait for a later frame
+    GLuint gShadowBudget = 2;
+    GLuint gShadowPasses = 0; // Shadow map renders of the last frame
+    std::atomic<bool> gStaticSceneChanged(true); // A static object moved since the maps were drawn
+
+    // Low-poly stand-ins of the largest objects, rasterized on the CPU each frame to hide
+    // whatever is behind them before it is submitted
+    struct SceneOccluder
+    {
+        Entity entity;
+        OccluderMesh proxy; // In the entity's object space
+    };
+    std::vector<SceneOccluder> gOccluders;
+    OcclusionBuffer gOcclusionBuffer;
+    bool gOcclusionCulling = true; // O toggles occlusion culling
+    std::atomic<GLuint> gOccludedObjects(0); // Objects in the frustum hidden by occluders last frame
+
+    // H toggles GPU occlusion culling: objects seen last frame are drawn first, then the
+    // bounding boxes of all of them are tested against that depth with occlusion queries.
+    // It replaces the depth prepass, whose replayed draw list it cannot provide.
+    bool gGpuOcclusion = false;
+    OcclusionQueries gOcclusionQueries;
+    ShaderProgram gBoxProgram; // Depth-only bounding boxes for the queries
+    GLint gBoxSphere = -1; // uSphere of gBoxProgram
+    GLuint gQueryDrawnFirst = 0; // Objects of the last frame drawn without waiting for a query
+    GLuint gQueryConditional = 0; // Objects of the last frame drawn under conditional rendering
+
+    // Uniform handles of the cube program, resolved once after linking
+    struct CubeUniforms
+    {
+        GLint uTexture;
+        GLint uClusterTileSize;
+        GLint uClusterGrid;
+        GLint uClusterDepth;
+        GLint uShadowMap0;
+        GLint uShadowMap1;
+        GLint uShadowMatrix0;
+        GLint uShadowMatrix1;
+        GLint uShadowEnabled;
+    } gCubeUniforms;
+    // Frame uniform block and per-object storage buffer shared by both programs
+    SceneBuffers gSceneBuffers;
+    const GLuint MAX_SCENE_OBJECTS = 65536;
+    // Frame block, object data and indirect commands one frame streams through the ring
+    const GLsizeiptr SCENE_STREAM_BYTES = 4 * 1024 * 1024;
+    // Orders the scene's draws by state and depth, drawing repeated objects as instances
+    RenderQueue gRenderQueue;
+    // Every mesh in shared buffers, so the whole scene can go out through multi-draw indirect
+    MeshPool gMeshPool;
+    MultiDrawBatcher gMultiDraw;
+    bool gUseMultiDraw = true; // M toggles between multi-draw indirect and the render queue
+    // Draws recorded by the jobs, one list per chunk, before this thread submits them
+    CommandLists gSceneCommands;
+    CommandLists gShadowCommands;
+    // Static objects sharing a material are copied into world space back to back in the
+    // mesh pool and share one object entry, so multi-draw merges them into a few commands
+    std::vector<ObjectData> gStaticBatches;
+    bool gStaticBatching = true; // B toggles drawing the static batches
+    // Z toggles a depth-only pass before shading, so each pixel is lit once
+    bool gDepthPrepass = false;
+    GpuTimer gPrepassTimer;
+    GpuTimer gColorPassTimer;
+    bool gShowPassTimings = false; // T prints the GPU time of both passes once a second
+    float gPassTimingDelay = 0.0f;
+    // G switches between forward and deferred shading
+    bool gDeferredShading = false;
+    GBuffer gGBuffer;
+    GLuint gFullscreenVao = 0; // No attributes, the lighting triangle is made from gl_VertexID
+    GpuTimer gGeometryPassTimer;
+    GpuTimer gLightingPassTimer;
     // Shape Meshes from Professor Battersby
     Meshes meshes;
-    // Texture id
-    GLuint gTextureId1, gTextureId2, gTextureId3, gTextureId4, gTextureId5, gTextureId6;
+    // Every surface texture is a layer of gTextures, chosen per object by its material
+    enum TextureLayer
+    {
+        TEXTURE_CERAMIC,
+        TEXTURE_WOOD,
+        TEXTURE_METALLIC_PURPLE,
+        TEXTURE_BLACK,
+        TEXTURE_BLUE,
+        TEXTURE_CARD,
+        TEXTURE_LAYER_COUNT
+    };
+    const char* const TEXTURE_FILES[TEXTURE_LAYER_COUNT] = { "ceramic.jpg", "wood.jpg", "metallic purple.jpg", "black.jpg", "blue.jpg", "card.jpg" };
+    const GLsizei MAX_TEXTURE_LAYER_SIZE = 2048;
+    TextureArray gTextures;
     glm::vec2 gUVScale(1.0f, 3.0f);
     GLint gTexWrapMode = GL_REPEAT;
 
@@ -60,12 +204,105 @@ namespace
     float gLastFrame = 0.0f;
 
     bool isOrtho = false; // boolean to handle ortho checks
+    // Clip planes of both projections
+    const float NEAR_PLANE = 0.1f;
+    const float FAR_PLANE = 100.0f;
+    // State calls reaching the driver in one frame before a warning is printed
+    const GLuint GL_CALL_BUDGET = 64;
+    float gGLStatsDelay = 0.0f; // time until the next over-budget warning may print
     float inputDelay = 0.0f; // input delay for perspective change
 
     // Light information
     glm::vec3 gLightColor(1.0f, 0.84f, 0.67f);
     glm::vec3 gLightPosition(20.0f, 20.0f, 20.0f);
     glm::vec3 gLightScale(0.0f);
+    // Second light, black and at the origin unless configured
+    glm::vec3 gLightColor2(0.0f);
+    glm::vec3 gLightPosition2(0.0f);
+
+    // Lights beyond the two above; L fills it with DEMO_LIGHT_COUNT small lights over the desk
+    std::vector<PointLight> gPointLights;
+    const GLuint DEMO_LIGHT_COUNT = 1024;
+    // Every light of the frame, the two desk lights first
+    std::vector<PointLight> gFrameLights;
+    // Lights binned into view space clusters for the forward shader
+    LightClusters gLightClusters;
+    const GLuint MAX_LIGHTS = 4096;
+
+    // Size of the window's framebuffer in pixels
+    int gFramebufferWidth = WINDOW_WIDTH;
+    int gFramebufferHeight = WINDOW_HEIGHT;
+
+    // The scene is drawn offscreen at a fraction of the window's size, chosen to keep the
+    // GPU time of a frame near FRAME_TIME_TARGET, then upscaled with a sharpening filter
+    DynamicResolution gDynamicResolution;
+    const float MIN_RENDER_SCALE = 0.5f;
+    const float MAX_RENDER_SCALE = 1.0f;
+    const float FRAME_TIME_TARGET = 16.0f; // milliseconds
+    const float UPSCALE_SHARPNESS = 0.5f; // Sharpening applied when the scale is below 1
+    GpuTimer gFrameTimer; // Whole frame, from the shadow maps to the upscale
+    ShaderProgram gUpscaleProgram;
+    GLint gUpscaleOutputSize = -1; // uOutputSize of gUpscaleProgram
+    GLint gUpscaleSharpness = -1; // uSharpness of gUpscaleProgram
+
+    // X cycles the anti-aliasing: FXAA filters the edges of the finished single sampled
+    // image, MSAA draws the scene with several samples per pixel and resolves them.
+    // The deferred G-buffer is single sampled, so MSAA only smooths the forward path.
+    enum AntiAliasing
+    {
+        AA_NONE,
+        AA_FXAA,
+        AA_MSAA_2X,
+        AA_MSAA_4X,
+        AA_MSAA_8X,
+        AA_MODE_COUNT
+    };
+    const char* const AA_NAMES[AA_MODE_COUNT] = { "no anti-aliasing", "FXAA", "2x MSAA", "4x MSAA", "8x MSAA" };
+    const GLsizei AA_SAMPLES[AA_MODE_COUNT] = { 1, 1, 2, 4, 8 };
+    AntiAliasing gAntiAliasing = AA_FXAA;
+    ShaderProgram gFxaaProgram;
+    GpuTimer gAntiAliasTimer; // The FXAA pass or the MSAA resolve
+
+    // The main thread handles the window's events, input and the camera; a render thread
+    // owns the GL context. Every update tick publishes a FrameState, and the render thread
+    // draws from the newest one it has taken, so a slow update never holds up a frame
+    // and the next tick is simulated while the last one is being drawn.
+    struct FrameState
+    {
+        glm::mat4 view;
+        glm::mat4 projection;
+        glm::vec3 viewPosition;
+        int framebufferWidth; // Size of the window's framebuffer
+        int framebufferHeight;
+        bool useMultiDraw;
+        bool depthPrepass;
+        bool deferredShading;
+        bool demoLights;
+        bool occlusionCulling;
+        bool gpuOcclusion;
+        bool staticBatching;
+        bool dynamicResolution;
+        AntiAliasing antiAliasing;
+        bool showPassTimings;
+    };
+    FrameState gUpdateState; // Owned by the main thread, copied out on every publish
+    TripleBuffer<FrameState> gFrameStates;
+    std::thread gRenderThread;
+    std::atomic<bool> gRenderQuit(false);
+    const double UPDATE_INTERVAL = 1.0 / 120.0; // Longest the main thread waits for events between ticks
+
+    // Components of every desk scene object
+    const ComponentMask SCENE_OBJECT_MASK = ComponentBit(COMPONENT_TRANSFORM) | ComponentBit(COMPONENT_MESH) |
+        ComponentBit(COMPONENT_MATERIAL) | ComponentBit(COMPONENT_BOUNDS) | ComponentBit(COMPONENT_VISIBILITY);
+
+    // Desk scene objects are entities of gWorld, placed by nodes of gSceneGraph
+    EntityWorld gWorld;
+    SceneGraph gSceneGraph;
+    // Workers for the per-chunk scene systems
+    JobSystem gJobs;
+    // Baked per-vertex ambient occlusion of every scene object, back to back
+    GLuint gAOBuffer = 0;
+    const char* const AO_CACHE_FILE = "desk_ao.cache";
 }
 
 // Function declarations
@@ -75,11 +312,33 @@ void UProcessInput(GLFWwindow* window);
 void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos);
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
-void URender();
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
-void UDestroyShaderProgram(GLuint programId);
-bool UCreateTexture(const char* filename, GLuint& textureId);
-void UDestroyTexture(GLuint textureId);
+void URender(const FrameState& state);
+void URenderThread();
+void UPublishFrameState();
+void UApplyFrameState(const FrameState& state);
+void UCreateScene();
+void UUpdateSceneTransforms();
+void UCullScene(const glm::mat4& viewProjection);
+void UAddOccluder(int object, float inset);
+bool UBakeAmbientOcclusion();
+void UBuildStaticBatches(std::vector<GLfloat>& ao);
+void UDestroyAmbientOcclusion();
+bool UCreateSceneBuffers();
+void UUploadFrameData(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPosition);
+void UGenerateDrawPackets(const glm::mat4& view, GLuint programId);
+void UDrawWithOcclusionQueries(const glm::mat4& view, GLuint programId);
+void URenderDeferred(const glm::mat4& view, const glm::mat4& projection);
+void UGatherLights();
+void UUpdateShadows();
+GLuint UQueueShadowCasters(const glm::mat4& lightViewProjection, bool movable);
+glm::vec4 USceneSphere();
+void UBindShadowMaps(ShaderProgram& program, GLint shadowMap0, GLint shadowMap1, GLint shadowMatrix0, GLint shadowMatrix1, GLint shadowEnabled);
+void UBuildLightClusters(const glm::mat4& view, const glm::mat4& projection);
+void UCreateDemoLights();
+ObjectData UMakeObjectData(const TransformComponent& transform, const MaterialComponent& material, GLint baseVertex);
+IndirectItem UMakeIndirectItem(const TransformComponent& transform, const MeshComponent& mesh, const MaterialComponent& material);
+void URecordDraw(CommandList& list, const TransformComponent& transform, const MeshComponent& mesh,
+    const MaterialComponent& material, float depth, bool pooled);
 
 /* Cube Vertex Shader Source Code*/
 const GLchar* cubeVertexShaderSource = GLSL(440,
@@ -88,23 +347,63 @@ const GLchar* cubeVertexShaderSource = GLSL(440,
 layout(location = 1) in vec3 normal; // VAP position 1 for normals
 layout(location = 2) in vec2 textureCoordinate;
 
+layout(location = 4) in uint drawId; // VAP position 4 for the object index, from the draw's base instance
+
 out vec3 vertexNormal; // For outgoing normals to fragment shader
 out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
 out vec2 vertexTextureCoordinate;
+flat out uint vertexTextureLayer; // Layer of the texture array holding the object's texture
+out float vertexAmbientOcclusion;
+out float vertexViewDepth; // Distance along the view direction, selects the light cluster
+
+// Must match the depth prepass bit for bit for the GL_EQUAL depth test
+invariant gl_Position;
+
+// Camera and lights, written once per frame
+layout(std140) uniform FrameBlock
+{
+    mat4 view;
+    mat4 projection;
+    vec4 lightPosition[2];
+    vec4 lightColor[2];
+    vec4 viewPosition;
+} frame;
+
+// Per-object transforms and material, indexed by drawId
+struct ObjectData
+{
+    mat4 model;
+    mat3 normalMatrix;
+    vec4 color;
+    vec2 uvScale;
+    uint textureIndex;
+    int aoBase;
+};
+
+layout(std430) readonly buffer ObjectBlock
+{
+    ObjectData objects[];
+};
 
-//Uniform / Global variables for the  transform matrices
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// Baked per-vertex ambient occlusion of every object, starting at its aoBase
+layout(std430) readonly buffer AOBlock
+{
+    float ambientOcclusion[];
+};
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
+    mat4 model = objects[drawId].model;
+
+    gl_Position = frame.projection * frame.view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
 
     vertexFragmentPos = vec3(model * vec4(position, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
 
-    vertexNormal = mat3(transpose(inverse(model))) * normal; // get normal vectors in world space only and exclude normal translation properties
-    vertexTextureCoordinate = textureCoordinate;
+    vertexNormal = objects[drawId].normalMatrix * normal; // get normal vectors in world space only, using the inverse transpose computed on the CPU
+    vertexTextureCoordinate = textureCoordinate * objects[drawId].uvScale;
+    vertexTextureLayer = objects[drawId].textureIndex;
+    vertexAmbientOcclusion = ambientOcclusion[objects[drawId].aoBase + gl_VertexID];
+    vertexViewDepth = -(frame.view * vec4(vertexFragmentPos, 1.0f)).z;
 }
 );
 
@@ -115,64 +414,132 @@ const GLchar* cubeFragmentShaderSource = GLSL(440,
     in vec3 vertexNormal; // For incoming normals
 in vec3 vertexFragmentPos; // For incoming fragment position
 in vec2 vertexTextureCoordinate;
+flat in uint vertexTextureLayer;
+in float vertexAmbientOcclusion; // Baked occlusion, 1.0 when fully open
+in float vertexViewDepth;
 
 out vec4 fragmentColor; // For outgoing cube color to the GPU
 
-// Uniform / Global variables for object color, light color, light position, and camera/view position
-uniform vec3 objectColor;
-uniform vec3 lightColor;
-uniform vec3 lightColor2;
-uniform vec3 lightPos;
-uniform vec3 lightPos2;
-uniform vec3 viewPosition;
-uniform sampler2D uTexture; // Useful when working with multiple textures
-uniform vec2 uvScale;
+// Camera/view position
+layout(std140) uniform FrameBlock
+{
+    mat4 view;
+    mat4 projection;
+    vec4 lightPosition[2];
+    vec4 lightColor[2];
+    vec4 viewPosition;
+} frame;
+
+// Every light of the frame; a radius of 0 reaches everything without falloff
+struct PointLight
+{
+    vec4 positionRadius;
+    vec4 colorAmbient; // Color in rgb, ambient strength in a
+};
+
+layout(std430) readonly buffer LightBlock
+{
+    PointLight lights[];
+};
 
-void main()
+// First entry in lightIndices and number of lights, per cluster
+layout(std430) readonly buffer ClusterBlock
 {
-    /*Phong lighting model calculations to generate ambient, diffuse, and specular components*/
+    uvec2 clusters[];
+};
 
-    //Calculate Ambient lighting*/
-    float ambientStrength = 1.0f; // Set ambient or global lighting strength
-    vec3 ambient = ambientStrength * lightColor; // Generate ambient light color
-    float ambientStrength2 = 0.1f; // Set ambient or global lighting strength
-    vec3 ambient2 = ambientStrength2 * lightColor2; // Generate ambient light color
+layout(std430) readonly buffer LightIndexBlock
+{
+    uint lightIndices[];
+};
+
+uniform sampler2DArray uTexture; // Every surface texture, one per layer
+uniform vec2 uClusterTileSize; // Pixels covered by one cluster tile
+uniform vec3 uClusterGrid; // Clusters across, down and in depth
+uniform vec2 uClusterDepth; // Near plane and depth slices per unit of log depth
+uniform sampler2DShadow uShadowMap0; // Shadow maps of the two desk lights
+uniform sampler2DShadow uShadowMap1;
+uniform mat4 uShadowMatrix0;
+uniform mat4 uShadowMatrix1;
+uniform vec2 uShadowEnabled; // 1.0 for each desk light with a shadow map
+
+// Fraction of the light reaching worldPos, from four 2x2 PCF taps of the light's shadow map
+float SampleShadow(sampler2DShadow shadowMap, mat4 shadowMatrix, vec3 worldPos)
+{
+    vec4 coord = shadowMatrix * vec4(worldPos, 1.0);
+    coord.xyz /= coord.w;
+    if (coord.z >= 1.0)
+        return 1.0; // Beyond the light's far plane
+
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0));
+    float lit = texture(shadowMap, vec3(coord.xy + vec2(-0.5, -0.5) * texel, coord.z));
+    lit += texture(shadowMap, vec3(coord.xy + vec2(0.5, -0.5) * texel, coord.z));
+    lit += texture(shadowMap, vec3(coord.xy + vec2(-0.5, 0.5) * texel, coord.z));
+    lit += texture(shadowMap, vec3(coord.xy + vec2(0.5, 0.5) * texel, coord.z));
+    return lit * 0.25;
+}
 
-    //Calculate Diffuse lighting*/
-    vec3 norm = normalize(vertexNormal); // Normalize vectors to 1 unit
-    vec3 lightDirection = normalize(lightPos - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
-    float impact = max(dot(norm, lightDirection), 0.0);// Calculate diffuse impact by generating dot product of normal and light
-    vec3 diffuse = impact * lightColor; // Generate diffuse light color
+// Shadowing of frame light index, only the two desk lights cast shadows
+float ShadowVisibility(uint index, vec3 worldPos)
+{
+    if (index == 0u && uShadowEnabled.x > 0.0)
+        return SampleShadow(uShadowMap0, uShadowMatrix0, worldPos);
+    if (index == 1u && uShadowEnabled.y > 0.0)
+        return SampleShadow(uShadowMap1, uShadowMatrix1, worldPos);
+    return 1.0;
+}
 
-    vec3 lightDirection2 = normalize(lightPos2 - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
-    float impact2 = max(dot(norm, lightDirection2), 0.0);// Calculate diffuse impact by generating dot product of normal and light
-    vec3 diffuse2 = impact2 * lightColor2; // Generate diffuse light color
+void main()
+{
+    // Find the fragment's cluster from its pixel and view depth
+    vec3 cell = vec3(gl_FragCoord.xy / uClusterTileSize, log(vertexViewDepth / uClusterDepth.x) * uClusterDepth.y);
+    uvec3 clusterCell = uvec3(clamp(cell, vec3(0.0), uClusterGrid - 1.0));
+    uint clusterIndex = clusterCell.x + uint(uClusterGrid.x) * (clusterCell.y + uint(uClusterGrid.y) * clusterCell.z);
+    uvec2 cluster = clusters[clusterIndex];
 
-    //Calculate Specular lighting*/
-    float specularIntensity = 0.8f; // Set specular light strength
-    float highlightSize = 16.0f; // Set specular highlight size
-    float specularIntensity2 = 0.8f; // Set specular light strength
-    float highlightSize2 = 16.0f; // Set specular highlight size
+    vec3 norm = normalize(vertexNormal); // Normalize vectors to 1 unit
+    vec3 viewDir = normalize(frame.viewPosition.xyz - vertexFragmentPos); // Calculate view direction
+
+    /*Phong lighting model calculations to generate ambient, diffuse, and specular components, summed over the cluster's lights*/
+    vec3 phong = vec3(0.0);
+    for (uint i = 0u; i < cluster.y; i++) {
+        uint lightIndex = lightIndices[cluster.x + i];
+        PointLight light = lights[lightIndex];
+        vec3 lightPos = light.positionRadius.xyz;
+        vec3 lightColor = light.colorAmbient.rgb;
+
+        // Smooth falloff to zero at the radius, none for lights without one
+        float attenuation = 1.0;
+        if (light.positionRadius.w > 0.0) {
+            float distance = length(lightPos - vertexFragmentPos) / light.positionRadius.w;
+            attenuation = clamp(1.0 - distance * distance, 0.0, 1.0);
+            attenuation *= attenuation;
+        }
 
-    vec3 viewDir = normalize(viewPosition - vertexFragmentPos); // Calculate view direction
-    vec3 reflectDir = reflect(-lightDirection, norm);// Calculate reflection vector
-    vec3 reflectDir2 = reflect(-lightDirection2, norm);// Calculate reflection vector
+        //Calculate Ambient lighting, darkened in creases and contacts*/
+        vec3 ambient = light.colorAmbient.a * vertexAmbientOcclusion * lightColor;
 
-    //Calculate specular component
-    float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize);
-    vec3 specular = specularIntensity * specularComponent * lightColor;
+        //Calculate Diffuse lighting*/
+        vec3 lightDirection = normalize(lightPos - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
+        float impact = max(dot(norm, lightDirection), 0.0);// Calculate diffuse impact by generating dot product of normal and light
+        vec3 diffuse = impact * lightColor; // Generate diffuse light color
 
-    float specularComponent2 = pow(max(dot(viewDir, reflectDir2), 0.0), highlightSize2);
-    vec3 specular2 = specularIntensity2 * specularComponent2 * lightColor2;
+        //Calculate Specular lighting*/
+        float specularIntensity = 0.8f; // Set specular light strength
+        float highlightSize = 16.0f; // Set specular highlight size
+        vec3 reflectDir = reflect(-lightDirection, norm);// Calculate reflection vector
+        float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize);
+        vec3 specular = specularIntensity * specularComponent * lightColor;
 
-    // Texture holds the color to be used for all three components
-    vec4 textureColor = texture(uTexture, vertexTextureCoordinate * uvScale);
+        // Ambient light is not blocked by shadow casters
+        float shadow = ShadowVisibility(lightIndex, vertexFragmentPos);
+        phong += (ambient + (diffuse + specular) * shadow) * attenuation;
+    }
 
-    // Calculate phong result
-    vec3 phong = (ambient + diffuse + specular) * textureColor.xyz;
-    vec3 phong2 = (ambient2 + diffuse2 + specular2) * textureColor.xyz;
+    // Texture holds the color to be used for all three components
+    vec4 textureColor = texture(uTexture, vec3(vertexTextureCoordinate, float(vertexTextureLayer)));
 
-    fragmentColor = vec4(phong + phong2, 1.0); // Send lighting results to GPU
+    fragmentColor = vec4(phong * textureColor.xyz, 1.0); // Send lighting results to GPU
 }
 );
 
@@ -181,15 +548,37 @@ void main()
 const GLchar* lampVertexShaderSource = GLSL(440,
 
     layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
+layout(location = 4) in uint drawId; // VAP position 4 for the object index
 
-//Uniform / Global variables for the  transform matrices
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// Camera and lights, shared with the cube program
+layout(std140) uniform FrameBlock
+{
+    mat4 view;
+    mat4 projection;
+    vec4 lightPosition[2];
+    vec4 lightColor[2];
+    vec4 viewPosition;
+} frame;
+
+// Per-object transforms, shared with the cube program
+struct ObjectData
+{
+    mat4 model;
+    mat3 normalMatrix;
+    vec4 color;
+    vec2 uvScale;
+    uint textureIndex;
+    int aoBase;
+};
+
+layout(std430) readonly buffer ObjectBlock
+{
+    ObjectData objects[];
+};
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
+    gl_Position = frame.projection * frame.view * objects[drawId].model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
 }
 );
 
@@ -204,6 +593,340 @@ void main()
     fragmentColor = vec4(1.0f); // Set color to white (1.0f,1.0f,1.0f) with alpha 1.0
 }
 );
+/* Depth Prepass Vertex Shader Source Code*/
+const GLchar* depthVertexShaderSource = GLSL(440,
+
+    layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
+layout(location = 4) in uint drawId; // VAP position 4 for the object index
+
+// Computed exactly as in the cube vertex shader
+invariant gl_Position;
+
+// Camera and lights, shared with the cube program
+layout(std140) uniform FrameBlock
+{
+    mat4 view;
+    mat4 projection;
+    vec4 lightPosition[2];
+    vec4 lightColor[2];
+    vec4 viewPosition;
+} frame;
+
+// Per-object transforms, shared with the cube program
+struct ObjectData
+{
+    mat4 model;
+    mat3 normalMatrix;
+    vec4 color;
+    vec2 uvScale;
+    uint textureIndex;
+    int aoBase;
+};
+
+layout(std430) readonly buffer ObjectBlock
+{
+    ObjectData objects[];
+};
+
+void main()
+{
+    mat4 model = objects[drawId].model;
+
+    gl_Position = frame.projection * frame.view * model * vec4(position, 1.0f); // Same expression as the cube shader
+}
+);
+
+
+/* Shadow Map Vertex Shader Source Code, used with the depth prepass fragment shader*/
+const GLchar* shadowVertexShaderSource = GLSL(440,
+
+    layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
+layout(location = 4) in uint drawId; // VAP position 4 for the object index
+
+// Per-object transforms, shared with the cube program
+struct ObjectData
+{
+    mat4 model;
+    mat3 normalMatrix;
+    vec4 color;
+    vec2 uvScale;
+    uint textureIndex;
+    int aoBase;
+};
+
+layout(std430) readonly buffer ObjectBlock
+{
+    ObjectData objects[];
+};
+
+uniform mat4 uLightViewProjection;
+
+void main()
+{
+    gl_Position = uLightViewProjection * objects[drawId].model * vec4(position, 1.0f); // Into the light's clip space
+}
+);
+
+
+/* Occlusion Query Box Vertex Shader Source Code, used with the depth prepass fragment shader*/
+const GLchar* boxVertexShaderSource = GLSL(440,
+
+    layout(location = 0) in vec3 position; // Corner of the box from -1 to 1
+
+// Camera and lights, shared with the cube program
+layout(std140) uniform FrameBlock
+{
+    mat4 view;
+    mat4 projection;
+    vec4 lightPosition[2];
+    vec4 lightColor[2];
+    vec4 viewPosition;
+} frame;
+
+uniform vec4 uSphere; // World space bounding sphere, the box is drawn around it
+
+void main()
+{
+    gl_Position = frame.projection * frame.view * vec4(uSphere.xyz + position * uSphere.w, 1.0f);
+}
+);
+
+
+/* Depth Prepass Fragment Shader Source Code*/
+const GLchar* depthFragmentShaderSource = GLSL(440,
+
+    void main()
+{
+    // Depth only, color writes are masked off
+}
+);
+/* G-buffer Fragment Shader Source Code, used with the cube vertex shader*/
+const GLchar* gbufferFragmentShaderSource = GLSL(440,
+
+    in vec3 vertexNormal; // For incoming normals
+in vec3 vertexFragmentPos;
+in vec2 vertexTextureCoordinate;
+flat in uint vertexTextureLayer;
+in float vertexAmbientOcclusion; // Baked occlusion, 1.0 when fully open
+
+layout(location = 0) out vec4 gAlbedo; // Texture color in rgb, occlusion in a
+layout(location = 1) out vec2 gNormal; // Octahedral encoded world space normal
+
+uniform sampler2DArray uTexture;
+
+// Project the unit normal onto the octahedron |x| + |y| + |z| = 1 and fold the lower half over the corners
+vec2 EncodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 folded = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return n.z >= 0.0 ? n.xy : folded;
+}
+
+void main()
+{
+    gAlbedo = vec4(texture(uTexture, vec3(vertexTextureCoordinate, float(vertexTextureLayer))).rgb, vertexAmbientOcclusion);
+    gNormal = EncodeNormal(normalize(vertexNormal));
+}
+);
+
+
+/* Deferred Lighting Vertex Shader Source Code*/
+const GLchar* lightVertexShaderSource = GLSL(440,
+
+    void main()
+{
+    // One triangle covering the screen; the scissor rectangle limits it to the light
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
+);
+
+
+/* Deferred Lighting Fragment Shader Source Code*/
+const GLchar* lightFragmentShaderSource = GLSL(440,
+
+    out vec4 fragmentColor; // Added onto the other lights' results
+
+// Camera and lights, shared with the cube program
+layout(std140) uniform FrameBlock
+{
+    mat4 view;
+    mat4 projection;
+    vec4 lightPosition[2];
+    vec4 lightColor[2];
+    vec4 viewPosition;
+} frame;
+
+uniform sampler2D uAlbedo;
+uniform sampler2D uNormal;
+uniform sampler2D uDepth;
+uniform mat4 uInverseViewProjection;
+uniform vec4 uLightPosition; // Position in xyz, radius in w
+uniform vec3 uLightColor;
+uniform float uAmbientStrength;
+uniform int uShadowIndex; // Frame light index of this light, selects its shadow map
+uniform sampler2DShadow uShadowMap0; // Shadow maps of the two desk lights
+uniform sampler2DShadow uShadowMap1;
+uniform mat4 uShadowMatrix0;
+uniform mat4 uShadowMatrix1;
+uniform vec2 uShadowEnabled; // 1.0 for each desk light with a shadow map
+
+// Fraction of the light reaching worldPos, from four 2x2 PCF taps of the light's shadow map
+float SampleShadow(sampler2DShadow shadowMap, mat4 shadowMatrix, vec3 worldPos)
+{
+    vec4 coord = shadowMatrix * vec4(worldPos, 1.0);
+    coord.xyz /= coord.w;
+    if (coord.z >= 1.0)
+        return 1.0; // Beyond the light's far plane
+
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0));
+    float lit = texture(shadowMap, vec3(coord.xy + vec2(-0.5, -0.5) * texel, coord.z));
+    lit += texture(shadowMap, vec3(coord.xy + vec2(0.5, -0.5) * texel, coord.z));
+    lit += texture(shadowMap, vec3(coord.xy + vec2(-0.5, 0.5) * texel, coord.z));
+    lit += texture(shadowMap, vec3(coord.xy + vec2(0.5, 0.5) * texel, coord.z));
+    return lit * 0.25;
+}
+
+// Shadowing of frame light index, only the two desk lights cast shadows
+float ShadowVisibility(uint index, vec3 worldPos)
+{
+    if (index == 0u && uShadowEnabled.x > 0.0)
+        return SampleShadow(uShadowMap0, uShadowMatrix0, worldPos);
+    if (index == 1u && uShadowEnabled.y > 0.0)
+        return SampleShadow(uShadowMap1, uShadowMatrix1, worldPos);
+    return 1.0;
+}
+
+vec3 DecodeNormal(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(uDepth, pixel, 0).r;
+    if (depth == 1.0)
+        discard; // Background, nothing was drawn here
+
+    vec4 albedo = texelFetch(uAlbedo, pixel, 0);
+    vec3 norm = DecodeNormal(texelFetch(uNormal, pixel, 0).rg);
+
+    // World position from the pixel and its depth
+    vec2 uv = gl_FragCoord.xy / vec2(textureSize(uDepth, 0));
+    vec4 world = uInverseViewProjection * vec4(uv * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec3 fragmentPos = world.xyz / world.w;
+
+    // Smooth falloff to zero at the radius, none for lights without one
+    float attenuation = 1.0;
+    if (uLightPosition.w > 0.0) {
+        float distance = length(uLightPosition.xyz - fragmentPos) / uLightPosition.w;
+        attenuation = clamp(1.0 - distance * distance, 0.0, 1.0);
+        attenuation *= attenuation;
+    }
+
+    // Same Phong terms as the forward shader, for one light
+    vec3 ambient = uAmbientStrength * albedo.a * uLightColor;
+
+    vec3 lightDirection = normalize(uLightPosition.xyz - fragmentPos);
+    float impact = max(dot(norm, lightDirection), 0.0);
+    vec3 diffuse = impact * uLightColor;
+
+    vec3 viewDir = normalize(frame.viewPosition.xyz - fragmentPos);
+    vec3 reflectDir = reflect(-lightDirection, norm);
+    float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), 16.0);
+    vec3 specular = 0.8 * specularComponent * uLightColor;
+
+    float shadow = uShadowIndex >= 0 ? ShadowVisibility(uint(uShadowIndex), fragmentPos) : 1.0;
+    fragmentColor = vec4((ambient + (diffuse + specular) * shadow) * attenuation * albedo.rgb, 1.0);
+}
+);
+/* Upscale Fragment Shader Source Code*/
+const GLchar* upscaleFragmentShaderSource = GLSL(440,
+
+    out vec4 fragmentColor;
+
+uniform sampler2D uScene; // The scene at the render scale
+uniform vec2 uOutputSize; // Size of the window's framebuffer in pixels
+uniform float uSharpness; // 0 for plain bilinear filtering
+
+void main()
+{
+    vec2 uv = gl_FragCoord.xy / uOutputSize;
+    vec2 texel = 1.0 / vec2(textureSize(uScene, 0));
+
+    vec3 center = texture(uScene, uv).rgb;
+    vec3 left = texture(uScene, uv - vec2(texel.x, 0.0)).rgb;
+    vec3 right = texture(uScene, uv + vec2(texel.x, 0.0)).rgb;
+    vec3 down = texture(uScene, uv - vec2(0.0, texel.y)).rgb;
+    vec3 up = texture(uScene, uv + vec2(0.0, texel.y)).rgb;
+
+    // Unsharp mask against the four neighbours, kept inside their range so edges do not ring
+    vec3 sharpened = center + (center * 4.0 - left - right - down - up) * uSharpness;
+    vec3 low = min(center, min(min(left, right), min(down, up)));
+    vec3 high = max(center, max(max(left, right), max(down, up)));
+    fragmentColor = vec4(clamp(sharpened, low, high), 1.0);
+}
+);
+
+
+/* FXAA Fragment Shader Source Code*/
+const GLchar* fxaaFragmentShaderSource = GLSL(440,
+
+    out vec4 fragmentColor;
+
+uniform sampler2D uScene; // The scene at the render scale, single sampled
+
+// Contrast below the larger of these is not treated as an edge
+const float EDGE_THRESHOLD = 0.125;
+const float EDGE_THRESHOLD_MIN = 0.0312;
+// Longest step along an edge, in texels
+const float SPAN_MAX = 8.0;
+
+float Luma(vec3 color)
+{
+    return dot(color, vec3(0.299, 0.587, 0.114));
+}
+
+void main()
+{
+    vec2 texel = 1.0 / vec2(textureSize(uScene, 0));
+    vec2 uv = gl_FragCoord.xy * texel;
+
+    vec3 center = texture(uScene, uv).rgb;
+    float lumaM = Luma(center);
+    float lumaNW = Luma(textureOffset(uScene, uv, ivec2(-1, 1)).rgb);
+    float lumaNE = Luma(textureOffset(uScene, uv, ivec2(1, 1)).rgb);
+    float lumaSW = Luma(textureOffset(uScene, uv, ivec2(-1, -1)).rgb);
+    float lumaSE = Luma(textureOffset(uScene, uv, ivec2(1, -1)).rgb);
+    float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));
+    float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));
+
+    // Flat areas are left as they are
+    if (lumaMax - lumaMin < max(EDGE_THRESHOLD_MIN, lumaMax * EDGE_THRESHOLD)) {
+        fragmentColor = vec4(center, 1.0);
+        return;
+    }
+
+    // The edge runs across the luma gradient of the corners
+    vec2 direction = vec2((lumaSW + lumaSE) - (lumaNW + lumaNE), (lumaNW + lumaSW) - (lumaNE + lumaSE));
+    float reduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * 0.03125, 1.0 / 128.0);
+    float stretch = 1.0 / (min(abs(direction.x), abs(direction.y)) + reduce);
+    direction = clamp(direction * stretch, vec2(-SPAN_MAX), vec2(SPAN_MAX)) * texel;
+
+    // Blend along the edge, falling back to the shorter blend when the longer one
+    // picks up colors from across another edge
+    vec3 shortBlend = 0.5 * (texture(uScene, uv - direction / 6.0).rgb + texture(uScene, uv + direction / 6.0).rgb);
+    vec3 longBlend = shortBlend * 0.5 + 0.25 * (texture(uScene, uv - direction * 0.5).rgb + texture(uScene, uv + direction * 0.5).rgb);
+    float lumaLong = Luma(longBlend);
+    fragmentColor = vec4((lumaLong < lumaMin || lumaLong > lumaMax) ? shortBlend : longBlend, 1.0);
+}
+);
+
+
 /* Old Shader Code
 /* Vertex Shader Source Code
 const GLchar* vertexShaderSource = GLSL(440,
@@ -240,118 +963,272 @@ const GLchar* fragmentShaderSource = GLSL(440,
     }
 ); */
 
-// Images are loaded with Y axis going down, but OpenGL's Y axis goes up, so let's flip it
-void flipImageVertically(unsigned char* image, int width, int height, int channels)
-{
-    for (int j = 0; j < height / 2; ++j)
-    {
-        int index1 = j * width * channels;
-        int index2 = (height - 1 - j) * width * channels;
-
-        for (int i = width * channels; i > 0; --i)
-        {
-            unsigned char tmp = image[index1];
-            image[index1] = image[index2];
-            image[index2] = tmp;
-            ++index1;
-            ++index2;
+int main(int argc, char* argv[]) {
+    // --benchmark times the math kernels against glm and exits, no window needed
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--benchmark") == 0) {
+            RunMathBenchmarks(100000, 20);
+            return EXIT_SUCCESS;
         }
     }
-}
 
-int main(int argc, char* argv[]) {
     if (!UInitialize(argc, argv, &gWindow)) {
         return EXIT_FAILURE;
     }
+    gJobs.Start();
 
     meshes.CreateMeshes(); // Creates the mesh
+    if (!gMeshPool.Create(meshes.GetMeshes()))
+        return EXIT_FAILURE;
 
     // Create the shader programs
-    if (!UCreateShaderProgram(cubeVertexShaderSource, cubeFragmentShaderSource, gCubeProgramId))
+    if (!gCubeProgram.Create(cubeVertexShaderSource, cubeFragmentShaderSource))
         return EXIT_FAILURE;
 
-    if (!UCreateShaderProgram(lampVertexShaderSource, lampFragmentShaderSource, gLampProgramId))
+    if (!gLampProgram.Create(lampVertexShaderSource, lampFragmentShaderSource))
         return EXIT_FAILURE;
 
-    // Load texture 1
-    const char* texFilename = "ceramic.jpg";
-    if (!UCreateTexture(texFilename, gTextureId1))
-    {
-        cout << "Failed to load texture " << texFilename << endl;
+    if (!gDepthProgram.Create(depthVertexShaderSource, depthFragmentShaderSource))
         return EXIT_FAILURE;
-    }
-    // Load texture 2
-    texFilename = "wood.jpg";
-    if (!UCreateTexture(texFilename, gTextureId2))
-    {
-        cout << "Failed to load texture " << texFilename << endl;
+
+    if (!gGBufferProgram.Create(cubeVertexShaderSource, gbufferFragmentShaderSource))
         return EXIT_FAILURE;
-    }
-    // Load texture 3
-    texFilename = "metallic purple.jpg";
-    if (!UCreateTexture(texFilename, gTextureId3))
-    {
-        cout << "Failed to load texture " << texFilename << endl;
+
+    if (!gLightProgram.Create(lightVertexShaderSource, lightFragmentShaderSource))
         return EXIT_FAILURE;
-    }
-    // Load texture 4
-    texFilename = "black.jpg";
-    if (!UCreateTexture(texFilename, gTextureId4))
-    {
-        cout << "Failed to load texture " << texFilename << endl;
+
+    if (!gShadowProgram.Create(shadowVertexShaderSource, depthFragmentShaderSource))
         return EXIT_FAILURE;
-    }
-    // Load texture 5
-    texFilename = "blue.jpg";
-    if (!UCreateTexture(texFilename, gTextureId5))
-    {
-        cout << "Failed to load texture " << texFilename << endl;
+    gShadowViewProjection = gShadowProgram.Uniform("uLightViewProjection");
+
+    if (!gBoxProgram.Create(boxVertexShaderSource, depthFragmentShaderSource))
         return EXIT_FAILURE;
-    }
-    // Load texture 6
-    texFilename = "card.jpg";
-    if (!UCreateTexture(texFilename, gTextureId6))
-    {
-        cout << "Failed to load texture " << texFilename << endl;
+    gBoxSphere = gBoxProgram.Uniform("uSphere");
+
+    if (!gShadowMaps[0].Create(SHADOW_MAP_SIZE) || !gShadowMaps[1].Create(SHADOW_MAP_SIZE))
+        return EXIT_FAILURE;
+
+    if (!gPrepassTimer.Create() || !gColorPassTimer.Create() || !gGeometryPassTimer.Create() || !gLightingPassTimer.Create() ||
+        !gFrameTimer.Create() || !gAntiAliasTimer.Create())
+        return EXIT_FAILURE;
+
+    // The same triangle as the lighting pass covers the window for the upscale
+    if (!gUpscaleProgram.Create(lightVertexShaderSource, upscaleFragmentShaderSource))
+        return EXIT_FAILURE;
+    gUpscaleOutputSize = gUpscaleProgram.Uniform("uOutputSize");
+    gUpscaleSharpness = gUpscaleProgram.Uniform("uSharpness");
+    gUpscaleProgram.SetInt(gUpscaleProgram.Uniform("uScene"), 0);
+
+    if (!gFxaaProgram.Create(lightVertexShaderSource, fxaaFragmentShaderSource))
+        return EXIT_FAILURE;
+    gFxaaProgram.SetInt(gFxaaProgram.Uniform("uScene"), 0);
+
+    // Scene target and G-buffer at the render scale of the window's framebuffer
+    glfwGetFramebufferSize(gWindow, &gFramebufferWidth, &gFramebufferHeight);
+    if (!gDynamicResolution.Create(gFramebufferWidth, gFramebufferHeight, MIN_RENDER_SCALE, MAX_RENDER_SCALE, FRAME_TIME_TARGET))
+        return EXIT_FAILURE;
+    if (!gGBuffer.Create(gDynamicResolution.width, gDynamicResolution.height))
+        return EXIT_FAILURE;
+    if (!gDynamicResolution.SetSamples(AA_SAMPLES[gAntiAliasing]))
+        return EXIT_FAILURE;
+
+    if (!gLightClusters.Create(MAX_LIGHTS, LightClusters::CLUSTER_COUNT * 64))
+        return EXIT_FAILURE;
+    glGenVertexArrays(1, &gFullscreenVao);
+
+    // Resolve uniform handles once, so no string lookups happen per frame
+    gCubeUniforms.uTexture = gCubeProgram.Uniform("uTexture");
+    gCubeUniforms.uClusterTileSize = gCubeProgram.Uniform("uClusterTileSize");
+    gCubeUniforms.uClusterGrid = gCubeProgram.Uniform("uClusterGrid");
+    gCubeUniforms.uClusterDepth = gCubeProgram.Uniform("uClusterDepth");
+    gCubeUniforms.uShadowMap0 = gCubeProgram.Uniform("uShadowMap0");
+    gCubeUniforms.uShadowMap1 = gCubeProgram.Uniform("uShadowMap1");
+    gCubeUniforms.uShadowMatrix0 = gCubeProgram.Uniform("uShadowMatrix0");
+    gCubeUniforms.uShadowMatrix1 = gCubeProgram.Uniform("uShadowMatrix1");
+    gCubeUniforms.uShadowEnabled = gCubeProgram.Uniform("uShadowEnabled");
+    gLightUniforms.uAlbedo = gLightProgram.Uniform("uAlbedo");
+    gLightUniforms.uNormal = gLightProgram.Uniform("uNormal");
+    gLightUniforms.uDepth = gLightProgram.Uniform("uDepth");
+    gLightUniforms.uInverseViewProjection = gLightProgram.Uniform("uInverseViewProjection");
+    gLightUniforms.uLightPosition = gLightProgram.Uniform("uLightPosition");
+    gLightUniforms.uLightColor = gLightProgram.Uniform("uLightColor");
+    gLightUniforms.uAmbientStrength = gLightProgram.Uniform("uAmbientStrength");
+    gLightUniforms.uShadowIndex = gLightProgram.Uniform("uShadowIndex");
+    gLightUniforms.uShadowMap0 = gLightProgram.Uniform("uShadowMap0");
+    gLightUniforms.uShadowMap1 = gLightProgram.Uniform("uShadowMap1");
+    gLightUniforms.uShadowMatrix0 = gLightProgram.Uniform("uShadowMatrix0");
+    gLightUniforms.uShadowMatrix1 = gLightProgram.Uniform("uShadowMatrix1");
+    gLightUniforms.uShadowEnabled = gLightProgram.Uniform("uShadowEnabled");
+
+    if (!UCreateSceneBuffers())
+        return EXIT_FAILURE;
+
+    // Load every texture into one array, one layer each
+    if (!gTextures.Create(std::vector<const char*>(TEXTURE_FILES, TEXTURE_FILES + TEXTURE_LAYER_COUNT), MAX_TEXTURE_LAYER_SIZE))
         return EXIT_FAILURE;
-    }
 
     // tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
-    glUseProgram(gCubeProgramId);
+    gCubeProgram.Use();
     // We set the texture as texture unit 0
-    glUniform1i(glGetUniformLocation(gCubeProgramId, "uTexture"), 0);
+    gCubeProgram.SetInt(gCubeUniforms.uTexture, 0);
+    gGBufferProgram.SetInt(gGBufferProgram.Uniform("uTexture"), 0);
+    gLightProgram.SetInt(gLightUniforms.uAlbedo, GBuffer::ALBEDO_UNIT);
+    gLightProgram.SetInt(gLightUniforms.uNormal, GBuffer::NORMAL_UNIT);
+    gLightProgram.SetInt(gLightUniforms.uDepth, GBuffer::DEPTH_UNIT);
+    gCubeProgram.SetInt(gCubeUniforms.uShadowMap0, SHADOW_UNIT);
+    gCubeProgram.SetInt(gCubeUniforms.uShadowMap1, SHADOW_UNIT + 1);
+    gLightProgram.SetInt(gLightUniforms.uShadowMap0, SHADOW_UNIT);
+    gLightProgram.SetInt(gLightUniforms.uShadowMap1, SHADOW_UNIT + 1);
+
+    // Lay out the desk and bake its contact shading (cached on disk after the first run)
+    UCreateScene();
+    if (!UBakeAmbientOcclusion())
+        cout << "Ambient occlusion bake failed, rendering without it" << endl;
+
+    // One occlusion query per scene object and frame in flight
+    if (!gOcclusionQueries.Create(gWorld.Size()))
+        return EXIT_FAILURE;
     
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f); // Clears background color
-
-    while (!glfwWindowShouldClose(gWindow)) { // Render loop
+    gGLState.ClearColor(0.0f, 0.0f, 0.0f, 1.0f); // Clears background color
+
+    // Start from what the render side is set up with
+    gUpdateState.framebufferWidth = gFramebufferWidth;
+    gUpdateState.framebufferHeight = gFramebufferHeight;
+    gUpdateState.useMultiDraw = gUseMultiDraw;
+    gUpdateState.depthPrepass = gDepthPrepass;
+    gUpdateState.deferredShading = gDeferredShading;
+    gUpdateState.demoLights = !gPointLights.empty();
+    gUpdateState.occlusionCulling = gOcclusionCulling;
+    gUpdateState.gpuOcclusion = gGpuOcclusion;
+    gUpdateState.staticBatching = gStaticBatching;
+    gUpdateState.dynamicResolution = gDynamicResolution.enabled;
+    gUpdateState.antiAliasing = gAntiAliasing;
+    gUpdateState.showPassTimings = gShowPassTimings;
+    UPublishFrameState();
+
+    // The context moves to the render thread; this one keeps the window's events
+    glfwMakeContextCurrent(NULL);
+    gRenderThread = std::thread(URenderThread);
+
+    while (!glfwWindowShouldClose(gWindow)) { // Update loop
         float currentFrame = glfwGetTime();
         gDeltaTime = currentFrame - gLastFrame;
         gLastFrame = currentFrame;
         inputDelay -= gDeltaTime;
 
         UProcessInput(gWindow); // Input
-        URender(); // Render frame
-        glfwPollEvents();
+        UPublishFrameState();
+        glfwWaitEventsTimeout(UPDATE_INTERVAL);
     }
 
+    gRenderQuit = true;
+    gRenderThread.join();
+    glfwMakeContextCurrent(gWindow);
+
     meshes.DestroyMeshes(); // Release mesh data
+    gMeshPool.Destroy();
+    gMultiDraw.Destroy();
+    UDestroyAmbientOcclusion();
+    gSceneBuffers.Destroy();
+    gPrepassTimer.Destroy();
+    gColorPassTimer.Destroy();
+    gGeometryPassTimer.Destroy();
+    gLightingPassTimer.Destroy();
+    gGBuffer.Destroy();
+    gDynamicResolution.Destroy();
+    gFrameTimer.Destroy();
+    gAntiAliasTimer.Destroy();
+    gLightClusters.Destroy();
+    gShadowMaps[0].Destroy();
+    gShadowMaps[1].Destroy();
+    gShadowDraw.Destroy();
+    gOcclusionQueries.Destroy();
+    gGLState.DeleteVertexArrays(1, &gFullscreenVao);
+    gJobs.Stop();
 
     // Release textures
-    UDestroyTexture(gTextureId1); 
-    UDestroyTexture(gTextureId2); 
-    UDestroyTexture(gTextureId3);
-    UDestroyTexture(gTextureId4);
-    UDestroyTexture(gTextureId5);
-    UDestroyTexture(gTextureId6);
+    gTextures.Destroy();
     
     // Release shader program
-    UDestroyShaderProgram(gCubeProgramId);
-    UDestroyShaderProgram(gLampProgramId);
+    gCubeProgram.Destroy();
+    gLampProgram.Destroy();
+    gDepthProgram.Destroy();
+    gGBufferProgram.Destroy();
+    gLightProgram.Destroy();
+    gShadowProgram.Destroy();
+    gBoxProgram.Destroy();
+    gUpscaleProgram.Destroy();
+    gFxaaProgram.Destroy();
 
     exit(EXIT_SUCCESS); // Terminates the program successfully
 }
 
 
+// Draws frames from the newest published FrameState until the update loop ends
+void URenderThread() {
+    glfwMakeContextCurrent(gWindow);
+
+    float lastFrame = glfwGetTime();
+    while (!gRenderQuit) {
+        float currentFrame = glfwGetTime();
+        float deltaTime = currentFrame - lastFrame;
+        lastFrame = currentFrame;
+        gGLStatsDelay -= deltaTime;
+        gPassTimingDelay -= deltaTime;
+
+        gFrameStates.Acquire();
+        const FrameState& state = gFrameStates.Front();
+
+        gGLState.BeginFrame();
+        gSceneBuffers.BeginFrame(); // Waits only if the GPU is FRAMES frames behind
+        UApplyFrameState(state);
+        URender(state); // Render frame
+        gSceneBuffers.EndFrame();
+
+        // Warn, at most once a second, when state changes stop being filtered
+        if (gGLState.frame.issued > GL_CALL_BUDGET && gGLStatsDelay <= 0) {
+            cout << "GL state calls this frame: " << gGLState.frame.issued << " issued, "
+                << gGLState.frame.filtered << " filtered (budget " << GL_CALL_BUDGET << ")" << endl;
+            gGLStatsDelay = 1.0f;
+        }
+
+        if (gShowPassTimings && gPassTimingDelay <= 0) {
+            if (gDeferredShading) {
+                cout << "GPU geometry pass " << gGeometryPassTimer.Milliseconds() << " ms, lighting pass "
+                    << gLightingPassTimer.Milliseconds() << " ms" << endl;
+            }
+            else {
+                if (gDepthPrepass)
+                    cout << "GPU depth prepass " << gPrepassTimer.Milliseconds() << " ms, ";
+                cout << "GPU color pass " << gColorPassTimer.Milliseconds() << " ms" << endl;
+            }
+            cout << "GPU frame " << gFrameTimer.Milliseconds() << " ms at " << gDynamicResolution.width << "x"
+                << gDynamicResolution.height << " (scale " << gDynamicResolution.scale << ")" << endl;
+            if (gAntiAliasing == AA_FXAA)
+                cout << "GPU FXAA pass " << gAntiAliasTimer.Milliseconds() << " ms" << endl;
+            else if (gAntiAliasing != AA_NONE)
+                cout << "GPU " << AA_NAMES[gAntiAliasing] << " resolve " << gAntiAliasTimer.Milliseconds() << " ms" << endl;
+            cout << "Shadow map renders last frame: " << gShadowPasses << " (budget " << gShadowBudget << ")" << endl;
+            if (gOcclusionCulling) {
+                cout << "Occlusion culled " << gOccludedObjects << " of " << gWorld.Size() << " objects with "
+                    << gOcclusionBuffer.nTriangles << " occluder triangles" << endl;
+            }
+            if (gUseMultiDraw) {
+                cout << "Multi-draw: " << gMultiDraw.nItems << " objects, " << gMultiDraw.nCommands << " commands, "
+                    << gMultiDraw.nDrawCalls << " draw calls" << (gStaticBatching ? " with static batching" : "") << endl;
+            }
+            if (gGpuOcclusion) {
+                cout << "Occlusion queries: " << gOcclusionQueries.nQueries << " issued, " << gQueryDrawnFirst
+                    << " objects drawn first, " << gQueryConditional << " drawn conditionally" << endl;
+            }
+            gPassTimingDelay = 1.0f;
+        }
+    }
+
+    glfwMakeContextCurrent(NULL);
+}
+
+
 // Initialize GLFW, GLEW, and create a window
 bool UInitialize(int argc, char* argv[], GLFWwindow** window) {
     // GLFW: initialize and configure
@@ -433,357 +1310,1088 @@ void UProcessInput(GLFWwindow* window) {
             inputDelay = 0.25f;
         }
     }
+
+    // Submission path input
+    if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS) {
+        if (inputDelay <= 0) {
+            gUpdateState.useMultiDraw = !gUpdateState.useMultiDraw;
+            cout << (gUpdateState.useMultiDraw ? "Submitting with multi-draw indirect" : "Submitting through the render queue") << endl;
+            inputDelay = 0.25f;
+        }
+    }
+
+    // Depth prepass input
+    if (glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS) {
+        if (inputDelay <= 0) {
+            gUpdateState.depthPrepass = !gUpdateState.depthPrepass;
+            cout << (gUpdateState.depthPrepass ? "Depth prepass on" : "Depth prepass off") << endl;
+            inputDelay = 0.25f;
+        }
+    }
+
+    // Shading path input
+    if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS) {
+        if (inputDelay <= 0) {
+            gUpdateState.deferredShading = !gUpdateState.deferredShading;
+            cout << (gUpdateState.deferredShading ? "Deferred shading" : "Forward shading") << endl;
+            inputDelay = 0.25f;
+        }
+    }
+
+    // Demo lights input
+    if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS) {
+        if (inputDelay <= 0) {
+            gUpdateState.demoLights = !gUpdateState.demoLights;
+            cout << (gUpdateState.demoLights ? DEMO_LIGHT_COUNT : 0) + 2 << " lights" << endl;
+            inputDelay = 0.25f;
+        }
+    }
+
+    // Occlusion culling input
+    if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS) {
+        if (inputDelay <= 0) {
+            gUpdateState.occlusionCulling = !gUpdateState.occlusionCulling;
+            cout << (gUpdateState.occlusionCulling ? "Occlusion culling on" : "Occlusion culling off") << endl;
+            inputDelay = 0.25f;
+        }
+    }
+
+    // GPU occlusion culling input
+    if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS) {
+        if (inputDelay <= 0) {
+            gUpdateState.gpuOcclusion = !gUpdateState.gpuOcclusion;
+            cout << (gUpdateState.gpuOcclusion ? "GPU occlusion queries on" : "GPU occlusion queries off") << endl;
+            inputDelay = 0.25f;
+        }
+    }
+
+    // Static batching input
+    if (glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS) {
+        if (inputDelay <= 0) {
+            gUpdateState.staticBatching = !gUpdateState.staticBatching;
+            cout << (gUpdateState.staticBatching ? "Static batching on" : "Static batching off") << endl;
+            inputDelay = 0.25f;
+        }
+    }
+
+    // Dynamic resolution input
+    if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS) {
+        if (inputDelay <= 0) {
+            gUpdateState.dynamicResolution = !gUpdateState.dynamicResolution;
+            cout << (gUpdateState.dynamicResolution ? "Dynamic resolution on" : "Dynamic resolution off") << endl;
+            inputDelay = 0.25f;
+        }
+    }
+
+    // Anti-aliasing input
+    if (glfwGetKey(window, GLFW_KEY_X) == GLFW_PRESS) {
+        if (inputDelay <= 0) {
+            gUpdateState.antiAliasing = (AntiAliasing)((gUpdateState.antiAliasing + 1) % AA_MODE_COUNT);
+            cout << AA_NAMES[gUpdateState.antiAliasing] << endl;
+            inputDelay = 0.25f;
+        }
+    }
+
+    // Pass timing input
+    if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS) {
+        if (inputDelay <= 0) {
+            gUpdateState.showPassTimings = !gUpdateState.showPassTimings;
+            inputDelay = 0.25f;
+        }
+    }
 }
 
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 void UResizeWindow(GLFWwindow* window, int width, int height) {
-    glViewport(0, 0, width, height);
+    // The render thread resizes its targets when the size reaches it; a minimized
+    // window keeps the old ones
+    if (width > 0 && height > 0) {
+        gUpdateState.framebufferWidth = width;
+        gUpdateState.framebufferHeight = height;
+    }
+}
+
+
+// Finishes the main thread's state with the camera's matrices and hands it to the
+// render thread
+void UPublishFrameState() {
+    FrameState& state = gUpdateState;
+    if (!isOrtho) {
+        state.view = gCamera.GetViewMatrix();
+        state.projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, NEAR_PLANE, FAR_PLANE);
+    }
+    else {
+        state.view = glm::translate(glm::vec3(0.0f, 0.0f, 0.0f));
+        state.projection = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, NEAR_PLANE, FAR_PLANE);
+    }
+    state.viewPosition = gCamera.Position;
+
+    gFrameStates.Back() = state;
+    gFrameStates.Publish();
+}
+
+
+// Brings the render thread's settings and targets in line with a new state
+void UApplyFrameState(const FrameState& state) {
+    gUseMultiDraw = state.useMultiDraw;
+    gDepthPrepass = state.depthPrepass;
+    gDeferredShading = state.deferredShading;
+    gOcclusionCulling = state.occlusionCulling;
+    gGpuOcclusion = state.gpuOcclusion;
+    gStaticBatching = state.staticBatching;
+    gDynamicResolution.enabled = state.dynamicResolution;
+    gShowPassTimings = state.showPassTimings;
+
+    if (state.demoLights != !gPointLights.empty()) {
+        if (state.demoLights)
+            UCreateDemoLights();
+        else
+            gPointLights.clear();
+    }
+
+    // The scene target and G-buffer follow the window
+    if (state.framebufferWidth != gFramebufferWidth || state.framebufferHeight != gFramebufferHeight) {
+        gFramebufferWidth = state.framebufferWidth;
+        gFramebufferHeight = state.framebufferHeight;
+        gDynamicResolution.Resize(gFramebufferWidth, gFramebufferHeight);
+        gGBuffer.Create(gDynamicResolution.width, gDynamicResolution.height);
+    }
+
+    if (state.antiAliasing != gAntiAliasing) {
+        gAntiAliasing = state.antiAliasing;
+        if (!gDynamicResolution.SetSamples(AA_SAMPLES[gAntiAliasing]))
+            cout << "Failed to create the multisampled scene target" << endl;
+        if (AA_SAMPLES[gAntiAliasing] > 1 && gDynamicResolution.samples != AA_SAMPLES[gAntiAliasing])
+            cout << AA_NAMES[gAntiAliasing] << " limited to " << gDynamicResolution.samples << " samples" << endl;
+    }
 }
 
 
 // Functioned called to render a frame
-void URender() {
-    glm::mat4 scale;
-    glm::mat4 rotation;
-    glm::mat4 translation;
-    glm::mat4 model;
-    glm::mat4 mainModel; // Allows for complex objects
-    glm::mat4 view;
-    glm::mat4 projection;
-    GLint modelLoc;
-    GLint viewLoc;
-    GLint projLoc;
-    GLint objectColorLoc;
+void URender(const FrameState& state) {
+    const glm::mat4& view = state.view;
+    const glm::mat4& projection = state.projection;
+
+    // Pick the render size from the GPU time of earlier frames
+    if (gDynamicResolution.Update(gFrameTimer.Milliseconds()) && gGBuffer.framebuffer)
+        gGBuffer.Create(gDynamicResolution.width, gDynamicResolution.height);
+    gFrameTimer.Begin();
+    gDynamicResolution.BindForWriting();
 
     // Enable z-depth
-    glEnable(GL_DEPTH_TEST);
+    gGLState.Enable(GL_DEPTH_TEST);
 
     // Changes to wireframe
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
     // Clear the frame and z buffers
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    gGLState.ClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    if (!isOrtho) {
-        view = gCamera.GetViewMatrix();
-        projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+    UUpdateSceneTransforms();
+
+    // Refresh whatever shadow maps the budget allows before anything samples them
+    UUpdateShadows();
+
+    // Camera and lights go to the GPU once for the whole frame
+    UUploadFrameData(view, projection, state.viewPosition);
+
+    // Only objects whose bounding sphere touches the view frustum, and that the occluders
+    // do not hide, are submitted
+    UCullScene(projection * view);
+
+    // Every light of the frame; the forward shader finds them through the cluster grid
+    UGatherLights();
+    if (!gDeferredShading) {
+        UBuildLightClusters(view, projection);
+        UBindShadowMaps(gCubeProgram, gCubeUniforms.uShadowMap0, gCubeUniforms.uShadowMap1,
+            gCubeUniforms.uShadowMatrix0, gCubeUniforms.uShadowMatrix1, gCubeUniforms.uShadowEnabled);
+    }
+
+    if (gDeferredShading) {
+        URenderDeferred(view, projection);
+    }
+    else if (gDepthPrepass && !gGpuOcclusion) {
+        // Lay down the nearest depth with color writes off, then shade only the fragments
+        // that match it, so hidden surfaces never run the lighting shader
+        gPrepassTimer.Begin();
+        gGLState.ColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        gGLState.DepthMask(GL_TRUE);
+        gGLState.DepthFunc(GL_LESS);
+        UGenerateDrawPackets(view, gDepthProgram.programId);
+        gPrepassTimer.End();
+
+        gColorPassTimer.Begin();
+        gGLState.ColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        gGLState.DepthMask(GL_FALSE);
+        gGLState.DepthFunc(GL_EQUAL);
+        if (gUseMultiDraw)
+            gMultiDraw.Redraw(gMeshPool, gCubeProgram.programId);
+        else
+            gRenderQueue.Redraw(gCubeProgram.programId);
+        gColorPassTimer.End();
+
+        // Depth writes must be back on for next frame's clear
+        gGLState.DepthMask(GL_TRUE);
+        gGLState.DepthFunc(GL_LESS);
     }
     else {
-        view = glm::translate(glm::vec3(0.0f, 0.0f, 0.0f));
-        projection = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, 0.1f, 100.0f);
+        // Visible objects become indirect commands or render queue packets
+        gColorPassTimer.Begin();
+        gGLState.ColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        gGLState.DepthMask(GL_TRUE);
+        gGLState.DepthFunc(GL_LESS);
+        UGenerateDrawPackets(view, gCubeProgram.programId);
+        gColorPassTimer.End();
     }
 
-    /*
-    * Object: Table
-    */
+    // Resolve the samples, or smooth the edges of the single sampled image
+    gGLState.Disable(GL_DEPTH_TEST);
+    gGLState.ActiveTexture(GL_TEXTURE0);
+    gGLState.BindVertexArray(gFullscreenVao);
+    GLuint sceneTexture = gDynamicResolution.colorTexture;
+    gAntiAliasTimer.Begin();
+    gDynamicResolution.Resolve();
+    if (gAntiAliasing == AA_FXAA) {
+        gDynamicResolution.BindFilteredForWriting();
+        gGLState.UseProgram(gFxaaProgram.programId);
+        gGLState.BindTexture(GL_TEXTURE_2D, sceneTexture);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        sceneTexture = gDynamicResolution.filteredTexture;
+    }
+    gAntiAliasTimer.End();
+
+    // Stretch the scene over the window, sharpening what the lower resolution softened
+    gGLState.BindFramebuffer(GL_FRAMEBUFFER, 0);
+    gGLState.Viewport(0, 0, gFramebufferWidth, gFramebufferHeight);
+    gGLState.UseProgram(gUpscaleProgram.programId);
+    gUpscaleProgram.SetVec2(gUpscaleOutputSize, glm::vec2(gFramebufferWidth, gFramebufferHeight));
+    gUpscaleProgram.SetFloat(gUpscaleSharpness, gDynamicResolution.scale < 1.0f ? UPSCALE_SHARPNESS : 0.0f);
+    gGLState.BindTexture(GL_TEXTURE_2D, sceneTexture);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    gGLState.BindVertexArray(0);
+    gFrameTimer.End();
 
-    // Set the shader to be used
-    glUseProgram(gCubeProgramId);
+    // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+    glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+}
 
-    // Retrieves and passes transform matrices to the Shader program
-    modelLoc = glGetUniformLocation(gCubeProgramId, "model");
-    viewLoc = glGetUniformLocation(gCubeProgramId, "view");
-    projLoc = glGetUniformLocation(gCubeProgramId, "projection");
-    //objectColorLoc = glGetUniformLocation(gCubeProgramId, "uObjectColor");
 
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+// Draws the visible objects into the G-buffer, then adds up every light's contribution
+// on the pixels its scissor rectangle covers, so each pixel is lit once per light
+// touching it whatever the number of objects
+void URenderDeferred(const glm::mat4& view, const glm::mat4& projection) {
+    glm::mat4 viewProjection = projection * view;
 
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(meshes.gPlaneMesh.vao); // Handle of cup
+    // Geometry pass: albedo, occlusion, normals and depth, no lighting
+    gGeometryPassTimer.Begin();
+    gGBuffer.BindForWriting();
+    gGLState.ColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    gGLState.DepthMask(GL_TRUE);
+    gGLState.DepthFunc(GL_LESS);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    UGenerateDrawPackets(view, gGBufferProgram.programId);
+    gGeometryPassTimer.End();
+
+    // Lighting pass: one additive screen triangle per light, clipped to the light's extent
+    gLightingPassTimer.Begin();
+    gDynamicResolution.BindForWriting();
+    gGLState.Disable(GL_DEPTH_TEST);
+    gGLState.Enable(GL_BLEND);
+    gGLState.BlendFunc(GL_ONE, GL_ONE);
+    gGLState.Enable(GL_SCISSOR_TEST);
+
+    gGBuffer.BindTextures();
+    UBindShadowMaps(gLightProgram, gLightUniforms.uShadowMap0, gLightUniforms.uShadowMap1,
+        gLightUniforms.uShadowMatrix0, gLightUniforms.uShadowMatrix1, gLightUniforms.uShadowEnabled);
+    gGLState.UseProgram(gLightProgram.programId);
+    gLightProgram.SetMat4(gLightUniforms.uInverseViewProjection, glm::inverse(viewProjection));
+    gGLState.BindVertexArray(gFullscreenVao);
+
+    for (GLuint i = 0; i < gFrameLights.size(); ++i) {
+        const PointLight& light = gFrameLights[i];
+        if (light.color == glm::vec3(0.0f))
+            continue; // adds nothing
+
+        GLint rect[4] = { 0, 0, gGBuffer.width, gGBuffer.height };
+        if (light.radius > 0.0f &&
+            !Culling::ScreenRect(glm::vec4(light.position, light.radius), viewProjection, gGBuffer.width, gGBuffer.height, rect))
+            continue;
+
+        gGLState.Scissor(rect[0], rect[1], rect[2], rect[3]);
+        gLightProgram.SetVec4(gLightUniforms.uLightPosition, glm::vec4(light.position, light.radius));
+        gLightProgram.SetVec3(gLightUniforms.uLightColor, light.color);
+        gLightProgram.SetFloat(gLightUniforms.uAmbientStrength, light.ambientStrength);
+        gLightProgram.SetInt(gLightUniforms.uShadowIndex, i < 2 ? (GLint)i : -1);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
 
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(10.0f, 10.0f, 10.0f));
-    // 2. Rotate the object
-    rotation = glm::rotate(0.0f, glm::vec3(1.0, 1.0f, 1.0f));
-    // 3. Position the object
-    translation = glm::translate(glm::vec3(0.0f, -1.0f, 0.0f));
-    // Model matrix: transformations are applied right-to-left order
-    model = translation * rotation * scale;
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+    gGLState.BindVertexArray(0);
+    gGLState.Disable(GL_SCISSOR_TEST);
+    gGLState.Disable(GL_BLEND);
+    gGLState.Enable(GL_DEPTH_TEST);
+    gLightingPassTimer.End();
+}
 
-    // Reference matrix uniforms from the Cube Shader program for the cub color, light color, light position, and camera position
-    objectColorLoc = glGetUniformLocation(gCubeProgramId, "objectColor");
-    GLint lightColorLoc = glGetUniformLocation(gCubeProgramId, "lightColor");
-    GLint lightPositionLoc = glGetUniformLocation(gCubeProgramId, "lightPos");
-    GLint viewPositionLoc = glGetUniformLocation(gCubeProgramId, "viewPosition");
 
-    // Pass color, light, and camera data to the Cube Shader program's corresponding uniforms
-    glUniform3f(objectColorLoc, 1.0f, 1.0f, 1.0f);
-    glUniform3f(lightColorLoc, gLightColor.r, gLightColor.g, gLightColor.b);
-    glUniform3f(lightPositionLoc, gLightPosition.x, gLightPosition.y, gLightPosition.z);
-    const glm::vec3 cameraPosition = gCamera.Position;
-    glUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
+// Collects the frame's lights into gFrameLights. The two desk lights reach everything
+// and keep their own ambient strengths.
+void UGatherLights() {
+    gFrameLights.clear();
+    gFrameLights.push_back({ gLightPosition, 0.0f, gLightColor, 1.0f });
+    gFrameLights.push_back({ gLightPosition2, 0.0f, gLightColor2, 0.1f });
+    gFrameLights.insert(gFrameLights.end(), gPointLights.begin(), gPointLights.end());
+}
 
-    GLint UVScaleLoc = glGetUniformLocation(gCubeProgramId, "uvScale");
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
 
-    glProgramUniform4f(gCubeProgramId, objectColorLoc, 1.0f, 1.0f, 0.0f, 1.0f);
+// Re-renders the shadow maps that are out of date, within gShadowBudget renders, and
+// draws this frame's movable casters over the static maps
+void UUpdateShadows() {
+    gShadowPasses = 0;
+    GLuint budget = gShadowBudget;
+
+    bool staticChanged = gStaticSceneChanged.exchange(false);
+    const glm::vec3 positions[2] = { gLightPosition, gLightPosition2 };
+    const glm::vec3 colors[2] = { gLightColor, gLightColor2 };
+
+    gGLState.Enable(GL_DEPTH_TEST);
+    gGLState.DepthFunc(GL_LESS);
+    gGLState.DepthMask(GL_TRUE);
+    gGLState.Enable(GL_POLYGON_OFFSET_FILL);
+    gGLState.PolygonOffset(2.0f, 4.0f); // slope scaled bias against shadow acne
+    gGLState.UseProgram(gShadowProgram.programId);
+
+    for (int i = 0; i < 2; ++i) {
+        ShadowMap& shadow = gShadowMaps[i];
+        shadow.hasDynamic = false;
+        if (staticChanged || positions[i] != shadow.lightPosition)
+            shadow.staticValid = false;
+
+        // A black light casts nothing visible
+        if (colors[i] == glm::vec3(0.0f)) {
+            shadow.enabled = false;
+            continue;
+        }
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureId2);
+        if (!shadow.staticValid && budget > 0) {
+            --budget;
+            shadow.staticValid = true;
+            if (!shadow.Fit(positions[i], USceneSphere()))
+                continue;
+
+            shadow.BeginStatic();
+            gShadowProgram.SetMat4(gShadowViewProjection, shadow.viewProjection);
+            if (UQueueShadowCasters(shadow.viewProjection, false) > 0)
+                gShadowDraw.Flush(gSceneBuffers, gMeshPool, gShadowProgram.programId);
+            ++gShadowPasses;
+        }
 
-    // Draws the triangles
-    glDrawElements(GL_TRIANGLES, meshes.gPlaneMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+        // Movable casters over a copy of the static map
+        if (shadow.enabled && budget > 0 && UQueueShadowCasters(shadow.viewProjection, true) > 0) {
+            --budget;
+            shadow.BeginDynamic();
+            gShadowProgram.SetMat4(gShadowViewProjection, shadow.viewProjection);
+            gShadowDraw.Flush(gSceneBuffers, gMeshPool, gShadowProgram.programId);
+            ++gShadowPasses;
+        }
+    }
 
-    // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
+    gGLState.Disable(GL_POLYGON_OFFSET_FILL);
+    gDynamicResolution.BindForWriting();
+}
 
-    /*
-    * Object: Cup
-    */
-    
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(meshes.gTaperedCylinderMesh.vao); // Main body of cup
-
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(1.0f, 1.0f, 1.0f));
-    // 2. Rotate the object
-    rotation = glm::rotate(3.14159f, glm::vec3(2.0, 0.0f, 1.0f));
-    // 3. Position the object
-    translation = glm::translate(glm::vec3(-2.0f, 0.01f, 0.0f));
-    // Model matrix: transformations are applied right-to-left order
-    mainModel = translation * rotation * scale;
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(mainModel));
-
-    glProgramUniform4f(gCubeProgramId, objectColorLoc, 0.0f, 1.0f, 1.0f, 1.0f);
-
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureId1);
-
-    // Draws the triangles
-    //glDrawArrays(GL_TRIANGLE_FAN, 0, 36);		//bottom
-    glDrawArrays(GL_TRIANGLE_FAN, 36, 36);		//top
-    glDrawArrays(GL_TRIANGLE_STRIP, 72, 146);	//sides
-
-    // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
-
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(meshes.gTorusMesh.vao); // Handle of cup
-
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(0.3f, 0.4f, 1.5f));
-    // 2. Rotate the object
-    rotation = glm::rotate(0.25f, glm::vec3(0.0, 0.0f, 0.18f));
-    // 3. Position the object
-    translation = glm::translate(glm::vec3(1.05f, 0.6f, 0.0f));
-    // Model matrix: transformations are applied right-to-left order
-    model = mainModel * translation * rotation * scale;
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-    glProgramUniform4f(gCubeProgramId, objectColorLoc, 0.0f, 0.0f, 1.0f, 1.0f);
-
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureId1);
-
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, meshes.gTorusMesh.nVertices);
-
-    // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
 
-    /*
-    * Object: Tissue Box
-    */
+// Adds the static or the movable objects inside a light's frustum to gShadowDraw and
+// returns how many there are. Chunks are culled and recorded by the jobs.
+GLuint UQueueShadowCasters(const glm::mat4& lightViewProjection, bool movable) {
+    Frustum frustum = Culling::ExtractFrustum(lightViewProjection);
+
+    static std::vector<EntityChunk*> chunks;
+    gWorld.Query(SCENE_OBJECT_MASK, chunks);
+
+    gShadowCommands.Begin((GLuint)chunks.size());
+    gJobs.ParallelFor((GLuint)chunks.size(), [&frustum, movable](GLuint chunkIndex) {
+        const EntityChunk& chunk = *chunks[chunkIndex];
+        const TransformComponent* transforms = chunk.Get<TransformComponent>();
+        const MeshComponent* meshComponents = chunk.Get<MeshComponent>();
+        const MaterialComponent* materials = chunk.Get<MaterialComponent>();
+
+        CommandList& list = gShadowCommands.List(chunkIndex);
+        GLuint visible[EntityChunk::CAPACITY];
+        GLuint nVisible = Culling::CullSpheres(frustum, (const glm::vec4*)chunk.Get<BoundsComponent>(), chunk.count, visible);
+        for (GLuint i = 0; i < nVisible; ++i) {
+            GLuint row = visible[i];
+            if (transforms[row].movable != movable)
+                continue;
+            URecordDraw(list, transforms[row], meshComponents[row], materials[row], 0.0f, true);
+        }
+    });
 
-    glBindVertexArray(meshes.gBoxMesh.vao);
+    gShadowDraw.Begin();
+    gShadowCommands.Replay(gShadowDraw);
+    return gShadowCommands.Size();
+}
 
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(4.0f, 1.5f, 2.0f));
-    // 2. Rotate the object
-    rotation = glm::rotate(3.14159f, glm::vec3(0.0, 0.0f, 1.0f));
-    // 3. Position the object
-    translation = glm::translate(glm::vec3(2.0f, -0.248f, 0.0f));
-    // Model matrix: transformations are applied right-to-left order
-    model = translation * rotation * scale;
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
 
-    glProgramUniform4f(gCubeProgramId, objectColorLoc, 0.0f, 1.0f, 1.0f, 1.0f);
+// Sphere around every scene object, for fitting the shadow frustums
+glm::vec4 USceneSphere() {
+    static std::vector<EntityChunk*> chunks;
+    gWorld.Query(ComponentBit(COMPONENT_BOUNDS), chunks);
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureId5);
+    glm::vec3 boxMin(1.0e30f), boxMax(-1.0e30f);
+    for (EntityChunk* chunk : chunks) {
+        const BoundsComponent* bounds = chunk->Get<BoundsComponent>();
+        for (GLuint row = 0; row < chunk->count; ++row) {
+            glm::vec3 center(bounds[row].sphere);
+            boxMin = glm::min(boxMin, center - glm::vec3(bounds[row].sphere.w));
+            boxMax = glm::max(boxMax, center + glm::vec3(bounds[row].sphere.w));
+        }
+    }
 
-    glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+    if (boxMin.x > boxMax.x)
+        return glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    return glm::vec4((boxMin + boxMax) * 0.5f, glm::length(boxMax - boxMin) * 0.5f);
+}
 
-    // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
 
-    /*
-    * Object: Metal cup
-    */
+// Binds the desk lights' shadow maps to their units and hands their matrices to program
+void UBindShadowMaps(ShaderProgram& program, GLint shadowMap0, GLint shadowMap1, GLint shadowMatrix0, GLint shadowMatrix1, GLint shadowEnabled) {
+    for (GLuint i = 0; i < 2; ++i) {
+        gGLState.ActiveTexture(GL_TEXTURE0 + SHADOW_UNIT + i);
+        gGLState.BindTexture(GL_TEXTURE_2D, gShadowMaps[i].Texture());
+    }
+    gGLState.ActiveTexture(GL_TEXTURE0);
+
+    program.SetMat4(shadowMatrix0, gShadowMaps[0].shadowMatrix);
+    program.SetMat4(shadowMatrix1, gShadowMaps[1].shadowMatrix);
+    program.SetVec2(shadowEnabled, glm::vec2(gShadowMaps[0].enabled ? 1.0f : 0.0f, gShadowMaps[1].enabled ? 1.0f : 0.0f));
+}
+
+
+// Bins gFrameLights into the cluster grid and hands the grid's layout to the cube program
+void UBuildLightClusters(const glm::mat4& view, const glm::mat4& projection) {
+    gLightClusters.Build(gFrameLights, view, projection, NEAR_PLANE, FAR_PLANE, gJobs);
+
+    glm::vec2 tileSize((float)gDynamicResolution.width / LightClusters::GRID_X, (float)gDynamicResolution.height / LightClusters::GRID_Y);
+    gCubeProgram.SetVec2(gCubeUniforms.uClusterTileSize, tileSize);
+    gCubeProgram.SetVec3(gCubeUniforms.uClusterGrid, glm::vec3(LightClusters::GRID_X, LightClusters::GRID_Y, LightClusters::GRID_Z));
+    gCubeProgram.SetVec2(gCubeUniforms.uClusterDepth, gLightClusters.DepthParameters());
+}
+
+
+// Scatters DEMO_LIGHT_COUNT small colored lights just above the desk
+void UCreateDemoLights() {
+    gPointLights.clear();
+    for (GLuint i = 0; i < DEMO_LIGHT_COUNT; ++i) {
+        float x = (float)rand() / RAND_MAX * 16.0f - 8.0f;
+        float z = (float)rand() / RAND_MAX * 16.0f - 8.0f;
+        float y = (float)rand() / RAND_MAX * 2.0f - 0.8f;
+        glm::vec3 color((float)rand() / RAND_MAX, (float)rand() / RAND_MAX, (float)rand() / RAND_MAX);
+        gPointLights.push_back({ glm::vec3(x, y, z), 1.5f, color * 0.4f, 0.0f });
+    }
+}
+
+
+// Adds an object to the desk scene and returns its entity; parent is another object's entity
+int UAddSceneObject(const char* name, const Meshes::GLMesh& mesh, TextureLayer texture, glm::vec3 color,
+    glm::vec3 scale, float angle, glm::vec3 axis, glm::vec3 position, int parent = -1) {
+    int parentNode = parent < 0 ? -1 : gWorld.Get<TransformComponent>(parent)->node;
+
+    // the scene is laid out depth first, so parents are always the last object or its ancestors
+    int node = gSceneGraph.AddNode(parentNode, { scale, glm::angleAxis(angle, glm::normalize(axis)), position });
+    if (node < 0) {
+        cout << "Scene object " << name << " is not placed depth first under its parent" << endl;
+        return -1;
+    }
+
+    Entity entity = gWorld.Create(SCENE_OBJECT_MASK);
 
-    glBindVertexArray(meshes.gCylinderMesh.vao); // Body of metal cup
+    TransformComponent* transform = gWorld.Get<TransformComponent>(entity);
+    transform->node = node;
+    transform->model = glm::mat4(1.0f);
 
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(0.7f, 3.5f, 0.7f));
-    // 2. Rotate the object
-    rotation = glm::rotate(3.14159f, glm::vec3(0.0, 0.0f, 1.0f));
-    // 3. Position the object
-    translation = glm::translate(glm::vec3(-4.0f, 2.525f, 0.0f));
-    // Model matrix: transformations are applied right-to-left order
-    mainModel = translation * rotation * scale;
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(mainModel));
+    gWorld.Get<MeshComponent>(entity)->mesh = &mesh;
 
-    glProgramUniform4f(gCubeProgramId, objectColorLoc, 0.0f, 1.0f, 1.0f, 1.0f);
+    // Every object binds the same array, so texture changes never split a batch
+    MaterialComponent* material = gWorld.Get<MaterialComponent>(entity);
+    material->textureId = gTextures.texture;
+    material->textureIndex = texture;
+    material->color = color;
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureId3);
+    return (int)entity;
+}
 
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 36);		//bottom
-    glDrawArrays(GL_TRIANGLE_FAN, 36, 36);		//top
-    glDrawArrays(GL_TRIANGLE_STRIP, 72, 146);	//sides
+// Adds a drawing command to a scene object
+void UAddDrawRange(int object, GLenum mode, GLint first, GLsizei count) {
+    if (object < 0)
+        return;
+    MeshComponent* mesh = gWorld.Get<MeshComponent>(object);
+    mesh->ranges[mesh->nRanges++] = { mode, first, count };
+}
 
-    // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
 
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(meshes.gCylinderMesh.vao); // Straw of metal cup
+// Lays out the desk scene; called once the meshes and textures exist
+void UCreateScene() {
+    const float PI = 3.14159f;
+    int object;
 
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(0.08f, 1.0f, 0.08f));
-    // 2. Rotate the object
-    rotation = glm::rotate(3.14159f, glm::vec3(0.0, 0.0f, 1.0f));
-    // 3. Position the object
-    translation = glm::translate(glm::vec3(0.0f, 0.6f, 0.0f));
-    // Model matrix: transformations are applied right-to-left order
-    model = mainModel * translation * rotation * scale;
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+    /*
+    * Object: Table
+    */
+    object = UAddSceneObject("Table", meshes.gTessellatedPlaneMesh, TEXTURE_WOOD, glm::vec3(1.0f, 1.0f, 1.0f),
+        glm::vec3(10.0f, 10.0f, 10.0f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.0f, -1.0f, 0.0f));
+    UAddDrawRange(object, GL_TRIANGLES, 0, meshes.gTessellatedPlaneMesh.nIndices);
+    UAddOccluder(object, 1.0f);
+
+    /*
+    * Object: Cup
+    */
+    int cup = UAddSceneObject("Cup", meshes.gTaperedCylinderMesh, TEXTURE_CERAMIC, glm::vec3(0.0f, 1.0f, 1.0f),
+        glm::vec3(1.0f, 1.0f, 1.0f), PI, glm::vec3(2.0f, 0.0f, 1.0f), glm::vec3(-2.0f, 0.01f, 0.0f));
+    //UAddDrawRange(cup, GL_TRIANGLE_FAN, 0, 36);   //bottom
+    UAddDrawRange(cup, GL_TRIANGLE_FAN, 36, 36);    //top
+    UAddDrawRange(cup, GL_TRIANGLE_STRIP, 72, 146); //sides
 
-    glProgramUniform4f(gCubeProgramId, objectColorLoc, 0.0f, 0.0f, 1.0f, 1.0f);
+    object = UAddSceneObject("Cup handle", meshes.gTorusMesh, TEXTURE_CERAMIC, glm::vec3(0.0f, 0.0f, 1.0f),
+        glm::vec3(0.3f, 0.4f, 1.5f), 0.25f, glm::vec3(0.0f, 0.0f, 0.18f), glm::vec3(1.05f, 0.6f, 0.0f), cup);
+    UAddDrawRange(object, GL_TRIANGLES, 0, meshes.gTorusMesh.nVertices);
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureId4);
+    /*
+    * Object: Tissue Box
+    */
+    object = UAddSceneObject("Tissue box", meshes.gBoxMesh, TEXTURE_BLUE, glm::vec3(0.0f, 1.0f, 1.0f),
+        glm::vec3(4.0f, 1.5f, 2.0f), PI, glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(2.0f, -0.248f, 0.0f));
+    UAddDrawRange(object, GL_TRIANGLES, 0, meshes.gBoxMesh.nIndices);
+    UAddOccluder(object, 1.0f);
 
-    glDrawArrays(GL_TRIANGLE_STRIP, 72, 146);	//sides
+    /*
+    * Object: Metal cup
+    */
+    int metalCup = UAddSceneObject("Metal cup", meshes.gCylinderMesh, TEXTURE_METALLIC_PURPLE, glm::vec3(0.0f, 1.0f, 1.0f),
+        glm::vec3(0.7f, 3.5f, 0.7f), PI, glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(-4.0f, 2.525f, 0.0f));
+    UAddDrawRange(metalCup, GL_TRIANGLE_FAN, 0, 36);      //bottom
+    UAddDrawRange(metalCup, GL_TRIANGLE_FAN, 36, 36);     //top
+    UAddDrawRange(metalCup, GL_TRIANGLE_STRIP, 72, 146);  //sides
+    UAddOccluder(metalCup, 0.7071f);   // square inside the round cross-section
 
-    // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
+    object = UAddSceneObject("Straw", meshes.gCylinderMesh, TEXTURE_BLACK, glm::vec3(0.0f, 0.0f, 1.0f),
+        glm::vec3(0.08f, 1.0f, 0.08f), PI, glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.6f, 0.0f), metalCup);
+    UAddDrawRange(object, GL_TRIANGLE_STRIP, 72, 146);    //sides
 
     /*
     * Object: Stack of cards
     */
+    int baseCard = UAddSceneObject("Card", meshes.gPlaneMesh, TEXTURE_CARD, glm::vec3(0.0f, 1.0f, 1.0f),
+        glm::vec3(0.5f, 1.0f, 0.8f), PI, glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(5.5f, -0.99f, 0.0f));
+    UAddDrawRange(baseCard, GL_TRIANGLES, 0, meshes.gPlaneMesh.nIndices);
+    if (baseCard >= 0)
+        gWorld.Get<MaterialComponent>(baseCard)->twoSided = true;
 
-    glBindVertexArray(meshes.gPlaneMesh.vao); // First card/base of stack
+    for (int i = 1; i <= 20; ++i) {
+        object = UAddSceneObject("Card", meshes.gPlaneMesh, TEXTURE_CARD, glm::vec3(0.0f, 1.0f, 1.0f),
+            glm::vec3(1.0f, 1.0f, 1.0f), PI, glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, i * (-0.005f), 0.0f), baseCard);
+        UAddDrawRange(object, GL_TRIANGLES, 0, meshes.gPlaneMesh.nIndices);
+        if (object >= 0)
+            gWorld.Get<MaterialComponent>(object)->twoSided = true;
+    }
 
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(0.5f, 1.0f, 0.8f));
-    // 2. Rotate the object
-    rotation = glm::rotate(3.14159f, glm::vec3(0.0, 0.0f, 1.0f));
-    // 3. Position the object
-    translation = glm::translate(glm::vec3(5.5f, -0.99f, 0.0f));
-    // Model matrix: transformations are applied right-to-left order
-    mainModel = translation * rotation * scale;
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(mainModel));
+    // Register every object's triangles with the mesh pool
+    std::vector<EntityChunk*> chunks;
+    gWorld.Query(ComponentBit(COMPONENT_MESH), chunks);
+    for (EntityChunk* chunk : chunks) {
+        MeshComponent* meshComponents = chunk->Get<MeshComponent>();
+        for (GLuint row = 0; row < chunk->count; ++row) {
+            MeshComponent& mesh = meshComponents[row];
+            mesh.poolRange = gMeshPool.Add(*mesh.mesh, mesh.ranges, mesh.nRanges);
+        }
+    }
+    gMeshPool.Upload();
 
-    glDrawElements(GL_TRIANGLES, meshes.gPlaneMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+    UUpdateSceneTransforms();
+}
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureId6);
 
-    glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+// Recomputes the world transform, normal matrix and bounds of the objects that moved,
+// one job per chunk
+void UUpdateSceneTransforms() {
+    if (gSceneGraph.Update() == 0)
+        return;
+
+    static std::vector<EntityChunk*> chunks;
+    gWorld.Query(ComponentBit(COMPONENT_TRANSFORM) | ComponentBit(COMPONENT_MESH) | ComponentBit(COMPONENT_BOUNDS), chunks);
+
+    gJobs.ParallelFor((GLuint)chunks.size(), [](GLuint chunkIndex) {
+        EntityChunk& chunk = *chunks[chunkIndex];
+        TransformComponent* transforms = chunk.Get<TransformComponent>();
+        MeshComponent* meshComponents = chunk.Get<MeshComponent>();
+        BoundsComponent* bounds = chunk.Get<BoundsComponent>();
+
+        // Gather the rows whose node moved, so their normal matrices go in one batched pass
+        GLuint rows[EntityChunk::CAPACITY];
+        glm::mat4 models[EntityChunk::CAPACITY];
+        NormalMatrix normalMatrices[EntityChunk::CAPACITY];
+        GLuint nChanged = 0;
+        for (GLuint row = 0; row < chunk.count; ++row) {
+            if (gSceneGraph.WasChanged(transforms[row].node)) {
+                rows[nChanged] = row;
+                models[nChanged] = gSceneGraph.World(transforms[row].node);
+                ++nChanged;
+            }
+        }
 
-    // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
+        SimdMath::ComputeNormalMatrices(models, normalMatrices, nChanged);
+
+        for (GLuint i = 0; i < nChanged; ++i) {
+            GLuint row = rows[i];
+            if (!transforms[row].movable)
+                gStaticSceneChanged = true;
+            transforms[row].model = models[i];
+            transforms[row].normalMatrix = normalMatrices[i];
+            bounds[row].sphere = Culling::TransformSphere(models[i], meshComponents[row].mesh->boundingSphere);
+            // its world space copy is out of date, so it is drawn on its own from now on
+            meshComponents[row].staticBatch = 0;
+        }
+    });
+}
 
-    for (int i = 1; i <= 20; ++i) {
-        glBindVertexArray(meshes.gPlaneMesh.vao);
 
-        // 1. Scales the object
-        scale = glm::scale(glm::vec3(1.0f, 1.0f, 1.0f));
-        // 2. Rotate the object
-        rotation = glm::rotate(3.14159f, glm::vec3(0.0, 0.0f, 1.0f));
-        // 3. Position the object
-        translation = glm::translate(glm::vec3(0.0f, i*(-0.005f), 0.0f));
-        // Model matrix: transformations are applied right-to-left order
-        model = mainModel * translation * rotation * scale;
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+// Gives a scene object a box occluder. The box is the mesh's bounding box with its x and z
+// extents scaled by inset around the center, which must keep it inside the object.
+void UAddOccluder(int object, float inset) {
+    if (object < 0)
+        return;
 
-        glDrawElements(GL_TRIANGLES, meshes.gPlaneMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+    const Meshes::GLMesh& mesh = *gWorld.Get<MeshComponent>(object)->mesh;
+    glm::vec3 center = (mesh.boundsMin + mesh.boundsMax) * 0.5f;
+    glm::vec3 extent = (mesh.boundsMax - mesh.boundsMin) * 0.5f * glm::vec3(inset, 1.0f, inset);
+
+    SceneOccluder occluder;
+    occluder.entity = object;
+    for (int corner = 0; corner < 8; ++corner) {
+        glm::vec3 sign((corner & 1) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f, (corner & 4) ? 1.0f : -1.0f);
+        occluder.proxy.vertices.push_back(center + extent * sign);
+    }
+    // two triangles per face, corners numbered by the bits of their x, y and z signs
+    const GLuint faces[6][4] = { { 0, 2, 6, 4 }, { 1, 5, 7, 3 }, { 0, 4, 5, 1 }, { 2, 3, 7, 6 }, { 0, 1, 3, 2 }, { 4, 6, 7, 5 } };
+    for (const GLuint* face : faces) {
+        const GLuint indices[6] = { face[0], face[1], face[2], face[0], face[2], face[3] };
+        occluder.proxy.indices.insert(occluder.proxy.indices.end(), indices, indices + 6);
+    }
+    gOccluders.push_back(occluder);
+}
 
-        // bind textures on corresponding texture units
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, gTextureId6);
 
-        glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+// Flags the objects inside the view frustum and not hidden by an occluder as visible,
+// one job per chunk
+void UCullScene(const glm::mat4& viewProjection) {
+    Frustum frustum = Culling::ExtractFrustum(viewProjection);
 
-        // Deactivate the Vertex Array Object
-        glBindVertexArray(0);
+    // The occluders are drawn into the CPU depth buffer before any object is tested
+    if (gOcclusionCulling) {
+        gOcclusionBuffer.Begin(viewProjection);
+        for (const SceneOccluder& occluder : gOccluders)
+            gOcclusionBuffer.AddOccluder(occluder.proxy, gWorld.Get<TransformComponent>(occluder.entity)->model);
+        gOcclusionBuffer.Rasterize(gJobs);
     }
+    gOccludedObjects = 0;
+
+    static std::vector<EntityChunk*> chunks;
+    gWorld.Query(ComponentBit(COMPONENT_BOUNDS) | ComponentBit(COMPONENT_VISIBILITY), chunks);
+
+    gJobs.ParallelFor((GLuint)chunks.size(), [&frustum](GLuint chunkIndex) {
+        EntityChunk& chunk = *chunks[chunkIndex];
+        VisibilityComponent* visibility = chunk.Get<VisibilityComponent>();
+
+        // The bounds column is a packed array of spheres
+        GLuint visible[EntityChunk::CAPACITY];
+        GLuint nVisible = Culling::CullSpheres(frustum, (const glm::vec4*)chunk.Get<BoundsComponent>(), chunk.count, visible);
+
+        for (GLuint row = 0; row < chunk.count; ++row)
+            visibility[row].visible = 0;
+        for (GLuint i = 0; i < nVisible; ++i)
+            visibility[visible[i]].visible = 1;
+
+        // An occluder's own bounds reach in front of its proxy, so it never hides itself
+        if (gOcclusionCulling) {
+            const BoundsComponent* bounds = chunk.Get<BoundsComponent>();
+            GLuint nOccluded = 0;
+            for (GLuint i = 0; i < nVisible; ++i) {
+                glm::vec4 sphere = bounds[visible[i]].sphere;
+                glm::vec3 center(sphere);
+                glm::vec3 radius(sphere.w);
+                if (!gOcclusionBuffer.IsVisible(center - radius, center + radius)) {
+                    visibility[visible[i]].visible = 0;
+                    nOccluded++;
+                }
+            }
+            gOccludedObjects += nOccluded;
+        }
+    });
+}
 
-    // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-    glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+
+// Turns the visible objects into multi-draw commands or render queue packets drawn
+// with programId. Jobs record the chunks' draws, object matrices included, into their
+// own command lists; this thread only replays them in chunk order and submits.
+void UGenerateDrawPackets(const glm::mat4& view, GLuint programId) {
+    if (gGpuOcclusion) {
+        UDrawWithOcclusionQueries(view, programId);
+        return;
+    }
+
+    static std::vector<EntityChunk*> chunks;
+    gWorld.Query(SCENE_OBJECT_MASK, chunks);
+
+    bool pooled = gUseMultiDraw;
+    gSceneCommands.Begin((GLuint)chunks.size());
+    gJobs.ParallelFor((GLuint)chunks.size(), [&view, pooled](GLuint chunkIndex) {
+        const EntityChunk& chunk = *chunks[chunkIndex];
+        const TransformComponent* transforms = chunk.Get<TransformComponent>();
+        const MeshComponent* meshComponents = chunk.Get<MeshComponent>();
+        const MaterialComponent* materials = chunk.Get<MaterialComponent>();
+        const VisibilityComponent* visibility = chunk.Get<VisibilityComponent>();
+
+        CommandList& list = gSceneCommands.List(chunkIndex);
+        for (GLuint row = 0; row < chunk.count; ++row) {
+            if (!visibility[row].visible)
+                continue;
+            float depth = -(view * transforms[row].model[3]).z;
+            URecordDraw(list, transforms[row], meshComponents[row], materials[row], depth, pooled);
+        }
+    });
+
+    if (gUseMultiDraw) {
+        // One indirect command per object, one multi-draw call per texture
+        gMultiDraw.Begin();
+        gSceneCommands.Replay(gMultiDraw);
+        gMultiDraw.Flush(gSceneBuffers, gMeshPool, programId);
+    }
+    else {
+        // Packets are sorted by program, texture, mesh and then front to back
+        gRenderQueue.Begin();
+        gSceneCommands.Replay(gRenderQueue, programId);
+        gRenderQueue.Execute(gSceneBuffers);
+    }
+}
+
+
+// Draws the visible objects with GPU occlusion culling. Objects whose last known query
+// passed go out first in one multi-draw, laying down the frame's occluders. Every
+// object's bounding box is then tested against that depth, and the objects hidden last
+// time are drawn under conditional rendering on their own test, so one coming into view
+// shows up the same frame. Results reach the CPU frames later, without waiting.
+void UDrawWithOcclusionQueries(const glm::mat4& view, GLuint programId) {
+    gOcclusionQueries.BeginFrame();
+    glm::vec3 eye(glm::inverse(view)[3]);
+
+    struct Candidate
+    {
+        Entity entity;
+        glm::vec4 sphere;
+        IndirectItem item;
+        bool wasVisible;
+    };
+    static std::vector<Candidate> candidates;
+    candidates.clear();
+
+    static std::vector<EntityChunk*> chunks;
+    gWorld.Query(SCENE_OBJECT_MASK, chunks);
+
+    gMultiDraw.Begin();
+    for (const EntityChunk* chunk : chunks) {
+        const TransformComponent* transforms = chunk->Get<TransformComponent>();
+        const MeshComponent* meshComponents = chunk->Get<MeshComponent>();
+        const MaterialComponent* materials = chunk->Get<MaterialComponent>();
+        const BoundsComponent* bounds = chunk->Get<BoundsComponent>();
+        const VisibilityComponent* visibility = chunk->Get<VisibilityComponent>();
+
+        for (GLuint row = 0; row < chunk->count; ++row) {
+            if (!visibility[row].visible)
+                continue;
+            IndirectItem item = UMakeIndirectItem(transforms[row], meshComponents[row], materials[row]);
+            Entity entity = chunk->entities[row];
+            bool wasVisible = gOcclusionQueries.WasVisible(entity);
+
+            // a box the near plane cuts through could fail its test while the object
+            // shows, so the camera being in or next to it counts as visible
+            glm::vec4 sphere = bounds[row].sphere;
+            glm::vec3 offset = glm::abs(eye - glm::vec3(sphere));
+            bool eyeInside = glm::max(glm::max(offset.x, offset.y), offset.z) < sphere.w + NEAR_PLANE * 2.0f;
+
+            if (wasVisible || eyeInside)
+                gMultiDraw.Add(item);
+            if (!eyeInside)
+                candidates.push_back({ entity, sphere, item, wasVisible });
+        }
+    }
+    gMultiDraw.Flush(gSceneBuffers, gMeshPool, programId);
+    gQueryDrawnFirst = gMultiDraw.nItems;
+
+    // Test every box against the depth drawn so far, writing nothing
+    gGLState.ColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    gGLState.DepthMask(GL_FALSE);
+    gGLState.UseProgram(gBoxProgram.programId);
+    for (const Candidate& candidate : candidates) {
+        gBoxProgram.SetVec4(gBoxSphere, candidate.sphere);
+        gOcclusionQueries.BeginQuery(candidate.entity);
+        gOcclusionQueries.DrawBox();
+        gOcclusionQueries.EndQuery();
+    }
+    gGLState.ColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    gGLState.DepthMask(GL_TRUE);
+
+    // The objects hidden last time get their own object data, drawId counting from 0
+    static std::vector<ObjectData> objects;
+    objects.clear();
+    for (const Candidate& candidate : candidates) {
+        if (!candidate.wasVisible)
+            objects.push_back(candidate.item.object);
+    }
+    GLuint count = std::min((GLuint)objects.size(), gSceneBuffers.StreamRoom(sizeof(ObjectData), 1));
+    gSceneBuffers.UpdateObjects(objects.data(), count);
+
+    gGLState.UseProgram(programId);
+    gGLState.BindVertexArray(gMeshPool.vao);
+    gGLState.ActiveTexture(GL_TEXTURE0);
+    gQueryConditional = 0;
+    for (const Candidate& candidate : candidates) {
+        if (candidate.wasVisible)
+            continue;
+        if (gQueryConditional >= count)
+            break;
+
+        const MeshPool::Range& range = candidate.item.range;
+        gGLState.BindTexture(GL_TEXTURE_2D_ARRAY, candidate.item.textureId);
+        bool conditional = gOcclusionQueries.BeginConditionalRender(candidate.entity);
+        glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, range.nIndices, GL_UNSIGNED_INT,
+            (void*)(sizeof(GLuint) * range.firstIndex), 1, range.baseVertex, gQueryConditional);
+        if (conditional)
+            gOcclusionQueries.EndConditionalRender();
+        gQueryConditional++;
+    }
+    gGLState.BindVertexArray(0);
 }
 
-// Implements the UCreateShaders function
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId) {
-    // Compilation and linkage error reporting
-    int success = 0;
-    char infoLog[512];
 
-    // Create a Shader program object.
-    programId = glCreateProgram();
+// Bakes per-vertex ambient occlusion for the static scene into gAOBuffer
+bool UBakeAmbientOcclusion() {
+    std::vector<EntityChunk*> chunks;
+    gWorld.Query(ComponentBit(COMPONENT_TRANSFORM) | ComponentBit(COMPONENT_MESH) | ComponentBit(COMPONENT_MATERIAL), chunks);
+
+    // Record where each object's values start; the vertex shader adds gl_VertexID
+    std::vector<AOInstance> instances;
+    GLuint base = 0;
+    for (EntityChunk* chunk : chunks) {
+        const TransformComponent* transforms = chunk->Get<TransformComponent>();
+        const MeshComponent* meshComponents = chunk->Get<MeshComponent>();
+        MaterialComponent* materials = chunk->Get<MaterialComponent>();
+        for (GLuint row = 0; row < chunk->count; ++row) {
+            instances.push_back({ meshComponents[row].mesh, transforms[row].model, materials[row].twoSided });
+            materials[row].aoBase = base;
+            base += meshComponents[row].mesh->nVertices;
+        }
+    }
 
-    // Create the vertex and fragment shader objects
-    GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+    AOBaker baker;
+    std::vector<GLfloat> ao;
+    bool baked = baker.Bake(instances, AO_CACHE_FILE, ao);
+    if (!baked)
+        ao.assign(base, 1.0f); // fully open, so shading matches a scene without AO
 
-    // Retrive the shader source
-    glShaderSource(vertexShaderId, 1, &vtxShaderSource, NULL);
-    glShaderSource(fragmentShaderId, 1, &fragShaderSource, NULL);
+    // the static batches' copies of the vertices need their own values
+    UBuildStaticBatches(ao);
 
-    // Compile the vertex shader, and print compilation errors (if any)
-    glCompileShader(vertexShaderId); // compile the vertex shader
-    // check for shader compile errors
-    glGetShaderiv(vertexShaderId, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(vertexShaderId, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+    glGenBuffers(1, &gAOBuffer);
+    gGLState.BindBuffer(GL_SHADER_STORAGE_BUFFER, gAOBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLfloat) * ao.size(), ao.data(), GL_STATIC_DRAW);
+    gGLState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, SceneBuffers::AO_BINDING, gAOBuffer);
+    gGLState.BindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
-        return false;
+    return baked;
+}
+
+
+// Copies every static object into world space, one region of the mesh pool per texture
+// layer and color, with normals brought through the normal matrix and renormalized.
+// Each object keeps its own index range inside its region, and its own bounds, so
+// culling still works per object. The AO values of the copied vertices are appended
+// to ao in the same order, to be found from the batch's aoBase.
+void UBuildStaticBatches(std::vector<GLfloat>& ao) {
+    gStaticBatches.clear();
+
+    struct StaticObject
+    {
+        const TransformComponent* transform;
+        MeshComponent* mesh;
+        const MaterialComponent* material;
+    };
+    std::vector<std::vector<StaticObject>> groups;
+
+    std::vector<EntityChunk*> chunks;
+    gWorld.Query(ComponentBit(COMPONENT_TRANSFORM) | ComponentBit(COMPONENT_MESH) | ComponentBit(COMPONENT_MATERIAL), chunks);
+    for (EntityChunk* chunk : chunks) {
+        const TransformComponent* transforms = chunk->Get<TransformComponent>();
+        MeshComponent* meshComponents = chunk->Get<MeshComponent>();
+        const MaterialComponent* materials = chunk->Get<MaterialComponent>();
+        for (GLuint row = 0; row < chunk->count; ++row) {
+            meshComponents[row].staticBatch = 0;
+            if (transforms[row].movable || meshComponents[row].poolRange.nIndices == 0)
+                continue;
+
+            // objects of a batch share one object entry, so everything in it but the
+            // geometry must match
+            size_t group = 0;
+            while (group < groups.size() && (groups[group][0].material->textureIndex != materials[row].textureIndex ||
+                groups[group][0].material->color != materials[row].color))
+                ++group;
+            if (group == groups.size())
+                groups.emplace_back();
+            groups[group].push_back({ &transforms[row], &meshComponents[row], &materials[row] });
+        }
     }
 
-    glCompileShader(fragmentShaderId); // compile the fragment shader
-    // check for shader compile errors
-    glGetShaderiv(fragmentShaderId, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(fragmentShaderId, sizeof(infoLog), NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+    std::vector<GLfloat> vertices;
+    std::vector<std::vector<GLuint>> triangles;
+    for (const std::vector<StaticObject>& group : groups) {
+        vertices.clear();
+        triangles.assign(group.size(), std::vector<GLuint>());
+        GLint aoStart = (GLint)ao.size();
+
+        for (size_t i = 0; i < group.size(); ++i) {
+            const StaticObject& object = group[i];
+            const Meshes::GLMesh& mesh = *object.mesh->mesh;
+            GLuint first = (GLuint)(vertices.size() / MeshPool::FLOATS_PER_VERTEX);
+
+            const NormalMatrix& normalColumns = object.transform->normalMatrix;
+            glm::mat3 normalMatrix(glm::vec3(normalColumns.columns[0]), glm::vec3(normalColumns.columns[1]), glm::vec3(normalColumns.columns[2]));
+            for (size_t v = 0; v < mesh.positions.size(); ++v) {
+                glm::vec3 position(object.transform->model * glm::vec4(mesh.positions[v], 1.0f));
+                glm::vec3 normal = glm::normalize(normalMatrix * mesh.normals[v]);
+                const glm::vec2& uv = mesh.texCoords[v];
+                vertices.insert(vertices.end(), { position.x, position.y, position.z, normal.x, normal.y, normal.z, uv.x, uv.y });
+
+                GLfloat occlusion = ao[object.material->aoBase + v];
+                ao.push_back(occlusion);
+            }
 
-        return false;
+            for (int range = 0; range < object.mesh->nRanges; ++range)
+                Meshes::AppendRangeTriangles(mesh, object.mesh->ranges[range], triangles[i]);
+            for (GLuint& index : triangles[i])
+                index += first;
+        }
+
+        // the ranges of one batch follow each other in the index buffer
+        GLint base = gMeshPool.AddVertices(vertices);
+        GLuint batch = (GLuint)gStaticBatches.size() + 1;
+        for (size_t i = 0; i < group.size(); ++i) {
+            group[i].mesh->staticRange = gMeshPool.AddTriangles(triangles[i], base);
+            group[i].mesh->staticBatch = batch;
+        }
+
+        ObjectData data;
+        data.model = glm::mat4(1.0f);
+        data.normalMatrix[0] = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+        data.normalMatrix[1] = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+        data.normalMatrix[2] = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+        data.color = glm::vec4(group[0].material->color, 1.0f);
+        data.uvScale = gUVScale;
+        data.textureIndex = group[0].material->textureIndex;
+        data.aoBase = aoStart - base;
+        gStaticBatches.push_back(data);
     }
+    gMeshPool.Upload();
+}
 
-    // Attached compiled shaders to the shader program
-    glAttachShader(programId, vertexShaderId);
-    glAttachShader(programId, fragmentShaderId);
 
-    glLinkProgram(programId);   // links the shader program
-    // check for linking errors
-    glGetProgramiv(programId, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
-        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+void UDestroyAmbientOcclusion() {
+    gGLState.DeleteBuffers(1, &gAOBuffer);
+    gAOBuffer = 0;
+}
 
+
+// Creates the frame and object buffers and connects both programs and all meshes to them
+bool UCreateSceneBuffers() {
+    if (!gSceneBuffers.Create(MAX_SCENE_OBJECTS, SCENE_STREAM_BYTES))
         return false;
+
+    ShaderProgram* programs[] = { &gCubeProgram, &gLampProgram, &gDepthProgram, &gGBufferProgram, &gLightProgram, &gShadowProgram, &gBoxProgram };
+    for (ShaderProgram* program : programs) {
+        program->BindUniformBlock(program->UniformBlock("FrameBlock"), SceneBuffers::FRAME_BINDING);
+        program->BindStorageBlock(program->StorageBlock("ObjectBlock"), SceneBuffers::OBJECT_BINDING);
+        program->BindStorageBlock(program->StorageBlock("AOBlock"), SceneBuffers::AO_BINDING);
+        program->BindStorageBlock(program->StorageBlock("LightBlock"), LightClusters::LIGHT_BINDING);
+        program->BindStorageBlock(program->StorageBlock("ClusterBlock"), LightClusters::CLUSTER_BINDING);
+        program->BindStorageBlock(program->StorageBlock("LightIndexBlock"), LightClusters::INDEX_BINDING);
     }
 
-    glUseProgram(programId);    // Uses the shader program
+    for (Meshes::GLMesh* mesh : meshes.GetMeshes())
+        gSceneBuffers.AttachDrawId(mesh->vao);
+    gSceneBuffers.AttachDrawId(gMeshPool.vao);
 
-    return true;
+    return gMultiDraw.Create(MAX_SCENE_OBJECTS) && gShadowDraw.Create(MAX_SCENE_OBJECTS);
 }
 
 
-void UDestroyShaderProgram(GLuint programId) {
-    glDeleteProgram(programId);
+// Writes this frame's camera and light block
+void UUploadFrameData(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPosition) {
+    FrameData frame;
+    frame.view = view;
+    frame.projection = projection;
+    frame.lightPosition[0] = glm::vec4(gLightPosition, 1.0f);
+    frame.lightPosition[1] = glm::vec4(gLightPosition2, 1.0f);
+    frame.lightColor[0] = glm::vec4(gLightColor, 1.0f);
+    frame.lightColor[1] = glm::vec4(gLightColor2, 1.0f);
+    frame.viewPosition = glm::vec4(viewPosition, 1.0f);
+    gSceneBuffers.UpdateFrame(frame);
+}
+
+
+// Builds an object's entry of the object buffer; baseVertex is the gl_VertexID of the
+// object's first vertex in the buffers it is drawn from
+ObjectData UMakeObjectData(const TransformComponent& transform, const MaterialComponent& material, GLint baseVertex) {
+    ObjectData data;
+    data.model = transform.model;
+    data.normalMatrix[0] = transform.normalMatrix.columns[0];
+    data.normalMatrix[1] = transform.normalMatrix.columns[1];
+    data.normalMatrix[2] = transform.normalMatrix.columns[2];
+    data.color = glm::vec4(material.color, 1.0f);
+    data.uvScale = gUVScale;
+    data.textureIndex = material.textureIndex;
+    data.aoBase = (GLint)material.aoBase - baseVertex;
+    return data;
+}
+
+// Builds an object's multi-draw item, from its static batch when it has one
+IndirectItem UMakeIndirectItem(const TransformComponent& transform, const MeshComponent& mesh, const MaterialComponent& material) {
+    IndirectItem item;
+    if (gStaticBatching && mesh.staticBatch != 0) {
+        item.range = mesh.staticRange;
+        item.object = gStaticBatches[mesh.staticBatch - 1];
+        item.batch = mesh.staticBatch;
+    }
+    else {
+        item.range = mesh.poolRange;
+        item.object = UMakeObjectData(transform, material, mesh.poolRange.baseVertex);
+    }
+    item.textureId = material.textureId;
+    return item;
+}
+
+// Records a draw of an object, with object data for the mesh pool when pooled and for
+// the mesh's own buffers otherwise
+void URecordDraw(CommandList& list, const TransformComponent& transform, const MeshComponent& mesh,
+    const MaterialComponent& material, float depth, bool pooled) {
+    DrawCommand command = { mesh.poolRange, 0, mesh.mesh, mesh.ranges, mesh.nRanges, material.textureId, depth, 0 };
+    if (!pooled) {
+        list.Draw(command, UMakeObjectData(transform, material, 0));
+        return;
+    }
+
+    IndirectItem item = UMakeIndirectItem(transform, mesh, material);
+    command.range = item.range;
+    command.batch = item.batch;
+    list.Draw(command, item.object);
 }
 
 // glfw: whenever the mouse moves, this callback is called
@@ -857,50 +2465,3 @@ void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
         }
     }
 }
-
-/*Generate and load the texture*/
-bool UCreateTexture(const char* filename, GLuint& textureId)
-{
-    int width, height, channels;
-    unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);
-    if (image)
-    {
-        flipImageVertically(image, width, height, channels);
-
-        glGenTextures(1, &textureId);
-        glBindTexture(GL_TEXTURE_2D, textureId);
-
-        // set the texture wrapping parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        // set texture filtering parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        if (channels == 3)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-        else if (channels == 4)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-        else
-        {
-            cout << "Not implemented to handle image with " << channels << " channels" << endl;
-            return false;
-        }
-
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        stbi_image_free(image);
-        glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
-
-        return true;
-    }
-
-    // Error loading the image
-    return false;
-}
-
-
-void UDestroyTexture(GLuint textureId)
-{
-    glGenTextures(1, &textureId);
-}
\ No newline at end of file
@@ -0,0 +1,384 @@
+///////////////////////////////////////////////////////////////////////////////
+// aobaker.cpp
+// ========
+// offline per-vertex ambient occlusion baking for static meshes
+//
+// Every vertex of every instance casts cosine weighted hemisphere rays
+// against the world space triangles of the whole static scene. Hits closer
+// than maxDistance occlude with a linear falloff. The work is spread over
+// all hardware threads and the result is cached on disk, keyed by a hash of
+// the scene geometry, transforms and bake settings.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "aobaker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+namespace
+{
+	const float PI = 3.14159265358979f;
+	const unsigned int CACHE_MAGIC = 0x31424f41;	// "AOB1"
+	const GLuint VERTICES_PER_JOB = 64;
+
+	// Van der Corput radical inverse, second coordinate of the Hammersley set
+	float RadicalInverse(GLuint bits)
+	{
+		bits = (bits << 16u) | (bits >> 16u);
+		bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+		bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+		bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+		bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+		return float(bits) * 2.3283064365386963e-10f;
+	}
+
+	// Integer hash used to decorrelate the sample pattern between vertices
+	GLuint HashSeed(GLuint x)
+	{
+		x ^= x >> 16;
+		x *= 0x7feb352du;
+		x ^= x >> 15;
+		x *= 0x846ca68bu;
+		x ^= x >> 16;
+		return x;
+	}
+
+	// 64-bit FNV-1a over raw bytes
+	void HashBytes(unsigned long long& hash, const void* data, size_t size)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+	}
+
+	// Slab test of a ray against an axis aligned box, limited to [0, tMax]
+	bool RayHitsBox(const glm::vec3& origin, const glm::vec3& invDirection, const glm::vec3& boxMin, const glm::vec3& boxMax, float tMax)
+	{
+		float tNear = 0.0f;
+		float tFar = tMax;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float t0 = (boxMin[axis] - origin[axis]) * invDirection[axis];
+			float t1 = (boxMax[axis] - origin[axis]) * invDirection[axis];
+			if (t0 > t1)
+				std::swap(t0, t1);
+			tNear = std::max(tNear, t0);
+			tFar = std::min(tFar, t1);
+			if (tNear > tFar)
+				return false;
+		}
+		return true;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Bake(const std::vector<AOInstance>&, const char*, std::vector<GLfloat>&)
+//
+//	instances: static mesh placements making up the scene
+//	cacheFile: path of the on-disk cache, may be NULL
+//	ao: receives nVertices values per instance, in order
+//
+//	Returns false only if the scene has nothing to bake
+///////////////////////////////////////////////////
+bool AOBaker::Bake(const std::vector<AOInstance>& instances, const char* cacheFile, std::vector<GLfloat>& ao)
+{
+	// per instance offsets into the output stream
+	std::vector<GLuint> firstVertex;
+	GLuint totalVertices = 0;
+	for (const AOInstance& instance : instances)
+	{
+		firstVertex.push_back(totalVertices);
+		totalVertices += instance.mesh->nVertices;
+	}
+
+	if (totalVertices == 0)
+		return false;
+
+	const unsigned long long key = UHashScene(instances);
+	if (cacheFile && ULoadCache(cacheFile, key, ao) && ao.size() == totalVertices)
+	{
+		std::cout << "INFO: Loaded ambient occlusion from " << cacheFile << std::endl;
+		return true;
+	}
+
+	UBuildOccluders(instances);
+	ao.assign(totalVertices, 1.0f);
+
+	GLuint threadCount = nThreads ? nThreads : std::max(1u, std::thread::hardware_concurrency());
+	std::atomic<GLuint> nextVertex(0);
+
+	// each worker grabs blocks of vertices until the whole scene is done
+	auto worker = [&]()
+	{
+		for (;;)
+		{
+			GLuint begin = nextVertex.fetch_add(VERTICES_PER_JOB);
+			if (begin >= totalVertices)
+				break;
+			GLuint end = std::min(begin + VERTICES_PER_JOB, totalVertices);
+
+			// find the instance owning the first vertex of the block
+			size_t instanceIndex = std::upper_bound(firstVertex.begin(), firstVertex.end(), begin) - firstVertex.begin() - 1;
+
+			for (GLuint global = begin; global < end; global++)
+			{
+				while (instanceIndex + 1 < instances.size() && global >= firstVertex[instanceIndex + 1])
+					instanceIndex++;
+
+				const AOInstance& instance = instances[instanceIndex];
+				GLuint local = global - firstVertex[instanceIndex];
+
+				glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(instance.model)));
+				glm::vec3 position = glm::vec3(instance.model * glm::vec4(instance.mesh->positions[local], 1.0f));
+				glm::vec3 normal = normalMatrix * instance.mesh->normals[local];
+				if (glm::dot(normal, normal) < 1e-12f)
+					continue;
+				normal = glm::normalize(normal);
+
+				float occlusion = UBakeVertex(position, normal, global);
+				if (instance.twoSided)
+					occlusion = std::max(occlusion, UBakeVertex(position, -normal, global));
+
+				ao[global] = occlusion;
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (GLuint i = 1; i < threadCount; i++)
+		threads.emplace_back(worker);
+	worker();
+	for (std::thread& thread : threads)
+		thread.join();
+
+	mTriangles.clear();
+	mOccluders.clear();
+
+	std::cout << "INFO: Baked ambient occlusion for " << totalVertices << " vertices on " << threadCount << " threads" << std::endl;
+
+	if (cacheFile)
+		USaveCache(cacheFile, key, ao);
+
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	UBuildOccluders(const std::vector<AOInstance>&)
+//
+//	Transform every instance's triangles to world space
+//	and compute the per instance bounds used to skip
+//	whole meshes during ray traversal
+///////////////////////////////////////////////////
+void AOBaker::UBuildOccluders(const std::vector<AOInstance>& instances)
+{
+	mTriangles.clear();
+	mOccluders.clear();
+
+	for (const AOInstance& instance : instances)
+	{
+		const Meshes::GLMesh& mesh = *instance.mesh;
+		if (mesh.triangles.empty())
+			continue;
+
+		Occluder occluder;
+		occluder.boundsMin = glm::vec3(1e30f);
+		occluder.boundsMax = glm::vec3(-1e30f);
+		occluder.firstTriangle = GLuint(mTriangles.size());
+
+		std::vector<glm::vec3> world(mesh.nVertices);
+		for (GLuint i = 0; i < mesh.nVertices; i++)
+		{
+			world[i] = glm::vec3(instance.model * glm::vec4(mesh.positions[i], 1.0f));
+			occluder.boundsMin = glm::min(occluder.boundsMin, world[i]);
+			occluder.boundsMax = glm::max(occluder.boundsMax, world[i]);
+		}
+
+		for (size_t i = 0; i + 2 < mesh.triangles.size(); i += 3)
+		{
+			Triangle triangle;
+			triangle.v0 = world[mesh.triangles[i]];
+			triangle.edge1 = world[mesh.triangles[i + 1]] - triangle.v0;
+			triangle.edge2 = world[mesh.triangles[i + 2]] - triangle.v0;
+			mTriangles.push_back(triangle);
+		}
+
+		occluder.nTriangles = GLuint(mTriangles.size()) - occluder.firstTriangle;
+		mOccluders.push_back(occluder);
+	}
+}
+
+///////////////////////////////////////////////////
+//	UBakeVertex(const glm::vec3&, const glm::vec3&, GLuint)
+//
+//	position, normal: world space vertex
+//	seed: per vertex value rotating the sample pattern
+//
+//	Returns the unoccluded fraction of the hemisphere
+//	around normal, 1 meaning fully open
+///////////////////////////////////////////////////
+float AOBaker::UBakeVertex(const glm::vec3& position, const glm::vec3& normal, GLuint seed) const
+{
+	// orthonormal basis around the normal (Duff et al. 2017)
+	float sign = normal.z >= 0.0f ? 1.0f : -1.0f;
+	float a = -1.0f / (sign + normal.z);
+	float b = normal.x * normal.y * a;
+	glm::vec3 tangent(1.0f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x);
+	glm::vec3 bitangent(b, sign + normal.y * normal.y * a, -normal.y);
+
+	// Cranley-Patterson rotation of the Hammersley set for this vertex
+	GLuint hash = HashSeed(seed);
+	float offsetU = float(hash & 0xffffu) / 65536.0f;
+	float offsetV = float(hash >> 16) / 65536.0f;
+
+	glm::vec3 origin = position + normal * bias;
+	float occlusion = 0.0f;
+
+	for (GLuint i = 0; i < nSamples; i++)
+	{
+		float u = (float(i) + 0.5f) / float(nSamples) + offsetU;
+		float v = RadicalInverse(i) + offsetV;
+		u -= std::floor(u);
+		v -= std::floor(v);
+
+		// cosine weighted direction in the local frame
+		float radius = std::sqrt(u);
+		float phi = 2.0f * PI * v;
+		glm::vec3 direction = tangent * (radius * std::cos(phi)) + bitangent * (radius * std::sin(phi)) + normal * std::sqrt(std::max(0.0f, 1.0f - u));
+
+		float t = UClosestHit(origin, direction);
+		if (t < maxDistance)
+			occlusion += 1.0f - t / maxDistance;
+	}
+
+	return 1.0f - occlusion / float(nSamples);
+}
+
+///////////////////////////////////////////////////
+//	UClosestHit(const glm::vec3&, const glm::vec3&)
+//
+//	Returns the distance to the nearest triangle along
+//	the ray, or maxDistance when nothing is hit closer
+///////////////////////////////////////////////////
+float AOBaker::UClosestHit(const glm::vec3& origin, const glm::vec3& direction) const
+{
+	glm::vec3 invDirection(
+		direction.x != 0.0f ? 1.0f / direction.x : 1e30f,
+		direction.y != 0.0f ? 1.0f / direction.y : 1e30f,
+		direction.z != 0.0f ? 1.0f / direction.z : 1e30f);
+
+	float closest = maxDistance;
+
+	for (const Occluder& occluder : mOccluders)
+	{
+		if (!RayHitsBox(origin, invDirection, occluder.boundsMin, occluder.boundsMax, closest))
+			continue;
+
+		// Moller-Trumbore, double sided
+		for (GLuint i = occluder.firstTriangle; i < occluder.firstTriangle + occluder.nTriangles; i++)
+		{
+			const Triangle& triangle = mTriangles[i];
+			glm::vec3 p = glm::cross(direction, triangle.edge2);
+			float det = glm::dot(triangle.edge1, p);
+			if (std::fabs(det) < 1e-9f)
+				continue;
+
+			float invDet = 1.0f / det;
+			glm::vec3 s = origin - triangle.v0;
+			float u = glm::dot(s, p) * invDet;
+			if (u < 0.0f || u > 1.0f)
+				continue;
+
+			glm::vec3 q = glm::cross(s, triangle.edge1);
+			float v = glm::dot(direction, q) * invDet;
+			if (v < 0.0f || u + v > 1.0f)
+				continue;
+
+			float t = glm::dot(triangle.edge2, q) * invDet;
+			if (t > 0.0f && t < closest)
+				closest = t;
+		}
+	}
+
+	return closest;
+}
+
+///////////////////////////////////////////////////
+//	UHashScene(const std::vector<AOInstance>&)
+//
+//	Key identifying the cache contents: bake settings,
+//	transforms and the full mesh geometry
+///////////////////////////////////////////////////
+unsigned long long AOBaker::UHashScene(const std::vector<AOInstance>& instances) const
+{
+	unsigned long long hash = 14695981039346656037ull;
+	HashBytes(hash, &nSamples, sizeof(nSamples));
+	HashBytes(hash, &maxDistance, sizeof(maxDistance));
+	HashBytes(hash, &bias, sizeof(bias));
+
+	for (const AOInstance& instance : instances)
+	{
+		const Meshes::GLMesh& mesh = *instance.mesh;
+		HashBytes(hash, &instance.model, sizeof(instance.model));
+		HashBytes(hash, &instance.twoSided, sizeof(instance.twoSided));
+		HashBytes(hash, &mesh.nVertices, sizeof(mesh.nVertices));
+		HashBytes(hash, mesh.positions.data(), mesh.positions.size() * sizeof(glm::vec3));
+		HashBytes(hash, mesh.normals.data(), mesh.normals.size() * sizeof(glm::vec3));
+		HashBytes(hash, mesh.triangles.data(), mesh.triangles.size() * sizeof(GLuint));
+	}
+
+	return hash;
+}
+
+///////////////////////////////////////////////////
+//	ULoadCache(const char*, unsigned long long, std::vector<GLfloat>&)
+//
+//	Returns true if the cache file exists and was baked
+//	for the same scene key
+///////////////////////////////////////////////////
+bool AOBaker::ULoadCache(const char* cacheFile, unsigned long long key, std::vector<GLfloat>& ao) const
+{
+	std::ifstream file(cacheFile, std::ios::binary);
+	if (!file)
+		return false;
+
+	unsigned int magic = 0;
+	unsigned long long storedKey = 0;
+	unsigned int count = 0;
+	file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+	file.read(reinterpret_cast<char*>(&storedKey), sizeof(storedKey));
+	file.read(reinterpret_cast<char*>(&count), sizeof(count));
+	if (!file || magic != CACHE_MAGIC || storedKey != key)
+		return false;
+
+	ao.resize(count);
+	file.read(reinterpret_cast<char*>(ao.data()), sizeof(GLfloat) * count);
+	return bool(file);
+}
+
+///////////////////////////////////////////////////
+//	USaveCache(const char*, unsigned long long, const std::vector<GLfloat>&)
+//
+//	Write the baked values; failure only costs a rebake
+///////////////////////////////////////////////////
+void AOBaker::USaveCache(const char* cacheFile, unsigned long long key, const std::vector<GLfloat>& ao) const
+{
+	std::ofstream file(cacheFile, std::ios::binary);
+	if (!file)
+	{
+		std::cout << "Failed to write ambient occlusion cache " << cacheFile << std::endl;
+		return;
+	}
+
+	unsigned int count = (unsigned int)ao.size();
+	file.write(reinterpret_cast<const char*>(&CACHE_MAGIC), sizeof(CACHE_MAGIC));
+	file.write(reinterpret_cast<const char*>(&key), sizeof(key));
+	file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+	file.write(reinterpret_cast<const char*>(ao.data()), sizeof(GLfloat) * count);
+}
@@ -0,0 +1,67 @@
+///////////////////////////////////////////////////////////////////////////////
+// aobaker.h
+// ========
+// offline per-vertex ambient occlusion baking for static meshes
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "meshes.h"
+
+// One placement of a static mesh in the baked scene
+struct AOInstance
+{
+	const Meshes::GLMesh* mesh;	// Mesh providing positions, normals and triangles
+	glm::mat4 model;			// World transform of the placement
+	bool twoSided;				// Thin surfaces take the more open of both hemispheres
+};
+
+class AOBaker
+{
+public:
+	GLuint nSamples = 64;		// Hemisphere rays per vertex
+	float maxDistance = 1.5f;	// Hits further away than this do not occlude
+	float bias = 0.002f;		// Ray origin offset along the normal to avoid self hits
+	GLuint nThreads = 0;		// Worker threads, 0 uses every hardware thread
+
+public:
+	// Bake one AO value per vertex of every instance, stored back to back in instance
+	// order. Results are loaded from cacheFile when the scene and settings still match,
+	// and written back to it after a fresh bake.
+	bool Bake(const std::vector<AOInstance>& instances, const char* cacheFile, std::vector<GLfloat>& ao);
+
+private:
+	// World space triangle, stored ready for the ray intersection test
+	struct Triangle
+	{
+		glm::vec3 v0;
+		glm::vec3 edge1;
+		glm::vec3 edge2;
+	};
+
+	// World space bounds of one instance and its range of triangles
+	struct Occluder
+	{
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+		GLuint firstTriangle;
+		GLuint nTriangles;
+	};
+
+	std::vector<Triangle> mTriangles;
+	std::vector<Occluder> mOccluders;
+
+	void UBuildOccluders(const std::vector<AOInstance>& instances);
+	float UBakeVertex(const glm::vec3& position, const glm::vec3& normal, GLuint seed) const;
+	float UClosestHit(const glm::vec3& origin, const glm::vec3& direction) const;
+
+	unsigned long long UHashScene(const std::vector<AOInstance>& instances) const;
+	bool ULoadCache(const char* cacheFile, unsigned long long key, std::vector<GLfloat>& ao) const;
+	void USaveCache(const char* cacheFile, unsigned long long key, const std::vector<GLfloat>& ao) const;
+};
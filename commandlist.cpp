@@ -0,0 +1,77 @@
+///////////////////////////////////////////////////////////////////////////////
+// commandlist.cpp
+// ========
+// draw commands recorded by worker jobs and replayed on the GL thread
+//
+// Walking the scene, culling and building object matrices is per object
+// work that parallelizes; issuing GL calls is not, since the context is
+// current on one thread. Splitting the two at a plain data command lets
+// jobs do the first part in per partition lists that need no locking,
+// while the GL thread only merges the lists and submits.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "commandlist.h"
+#include "multidrawbatcher.h"
+#include "renderqueue.h"
+
+void CommandList::Clear()
+{
+	mCommands.clear();
+	mObjects.clear();
+}
+
+void CommandList::Draw(const DrawCommand& command, const ObjectData& object)
+{
+	mCommands.push_back(command);
+	mCommands.back().object = (GLuint)mObjects.size();
+	mObjects.push_back(object);
+}
+
+void CommandLists::Begin(GLuint nLists)
+{
+	if (mLists.size() < nLists)
+		mLists.resize(nLists);
+	mCount = nLists;
+	for (GLuint i = 0; i < mCount; i++)
+		mLists[i].Clear();
+}
+
+GLuint CommandLists::Size() const
+{
+	GLuint size = 0;
+	for (GLuint i = 0; i < mCount; i++)
+		size += mLists[i].Size();
+	return size;
+}
+
+void CommandLists::Replay(MultiDrawBatcher& batcher) const
+{
+	for (GLuint i = 0; i < mCount; i++)
+	{
+		const CommandList& list = mLists[i];
+		for (GLuint c = 0; c < list.Size(); c++)
+		{
+			const DrawCommand& command = list.Command(c);
+			IndirectItem item;
+			item.range = command.range;
+			item.textureId = command.textureId;
+			item.object = list.Object(command);
+			item.batch = command.batch;
+			batcher.Add(item);
+		}
+	}
+}
+
+void CommandLists::Replay(RenderQueue& queue, GLuint programId) const
+{
+	for (GLuint i = 0; i < mCount; i++)
+	{
+		const CommandList& list = mLists[i];
+		for (GLuint c = 0; c < list.Size(); c++)
+		{
+			const DrawCommand& command = list.Command(c);
+			queue.Submit({ PASS_OPAQUE, command.mesh, command.ranges, command.nRanges, programId,
+				command.textureId, command.depth, list.Object(command) });
+		}
+	}
+}
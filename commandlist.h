@@ -0,0 +1,75 @@
+///////////////////////////////////////////////////////////////////////////////
+// commandlist.h
+// ========
+// draw commands recorded by worker jobs and replayed on the GL thread
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <vector>
+
+#include "meshes.h"
+#include "meshpool.h"
+#include "scenebuffers.h"
+
+class MultiDrawBatcher;
+class RenderQueue;
+
+// One recorded draw: the object's geometry in the forms both submission paths take,
+// its texture and depth, and where its object data is. Recording one makes no GL call.
+struct DrawCommand
+{
+	MeshPool::Range range;				// Triangles in the mesh pool, for multi-draw
+	GLuint batch;						// Static batch range belongs to, 0 for none
+	const Meshes::GLMesh* mesh;			// The same triangles as the mesh's own drawing commands
+	const Meshes::DrawRange* ranges;
+	int nRanges;
+	GLuint textureId;
+	float depth;						// View space distance, for the render queue's order
+	GLuint object;						// Entry of the command's list holding its object data
+};
+
+// Commands of one job, in recording order. The object data is kept apart so the
+// commands themselves stay a few words each.
+class CommandList
+{
+public:
+	void Clear();
+
+	// Append a command; its object field is set to where object is stored
+	void Draw(const DrawCommand& command, const ObjectData& object);
+
+	GLuint Size() const { return (GLuint)mCommands.size(); }
+	const DrawCommand& Command(GLuint i) const { return mCommands[i]; }
+	const ObjectData& Object(const DrawCommand& command) const { return mObjects[command.object]; }
+
+private:
+	std::vector<DrawCommand> mCommands;
+	std::vector<ObjectData> mObjects;
+};
+
+// One command list per partition of the scene. Jobs fill their partition's list in
+// parallel, then the GL thread replays the lists in partition order, so the result
+// does not depend on which thread ran which partition.
+class CommandLists
+{
+public:
+	// Clear the lists and make sure there are nLists of them
+	void Begin(GLuint nLists);
+
+	// Partition i's list; each must be recorded by one job at a time
+	CommandList& List(GLuint i) { return mLists[i]; }
+
+	// Commands in all lists
+	GLuint Size() const;
+
+	// Hand every command to a submission path, which does the GL work
+	void Replay(MultiDrawBatcher& batcher) const;
+	void Replay(RenderQueue& queue, GLuint programId) const;
+
+private:
+	std::vector<CommandList> mLists;
+	GLuint mCount = 0;	// Lists in use, mLists only grows so their storage is reused
+};
@@ -0,0 +1,174 @@
+///////////////////////////////////////////////////////////////////////////////
+// culling.cpp
+// ========
+// view-frustum culling of bounding spheres, four spheres per SSE test
+//
+// A sphere is outside when its center lies further than its radius
+// behind any plane. The SSE path keeps four spheres in structure-of-arrays
+// registers and tests them against one broadcast plane at a time, so one
+// pass over the six planes classifies four objects.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "culling.h"
+#include "simdmath.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef SIMDMATH_SSE
+#include <emmintrin.h>
+#endif
+
+namespace Culling
+{
+	///////////////////////////////////////////////////
+	//	ExtractFrustum(const glm::mat4&)
+	//
+	//	Gribb/Hartmann: each plane is the sum or difference
+	//	of the fourth row of the matrix and one other row.
+	//	Planes are normalized so the plane distance is a
+	//	true distance, comparable with a radius.
+	///////////////////////////////////////////////////
+	Frustum ExtractFrustum(const glm::mat4& viewProjection)
+	{
+		const glm::mat4& m = viewProjection;
+		glm::vec4 rows[4];
+		for (int r = 0; r < 4; r++)
+			rows[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+
+		Frustum frustum;
+		frustum.planes[0] = rows[3] + rows[0];	// left
+		frustum.planes[1] = rows[3] - rows[0];	// right
+		frustum.planes[2] = rows[3] + rows[1];	// bottom
+		frustum.planes[3] = rows[3] - rows[1];	// top
+		frustum.planes[4] = rows[3] + rows[2];	// near
+		frustum.planes[5] = rows[3] - rows[2];	// far
+
+		for (glm::vec4& plane : frustum.planes)
+		{
+			float length = glm::length(glm::vec3(plane));
+			if (length > 0.0f)
+				plane = plane * (1.0f / length);
+		}
+		return frustum;
+	}
+
+	glm::vec4 TransformSphere(const glm::mat4& model, const glm::vec4& sphere)
+	{
+		glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(sphere), 1.0f));
+
+		float scale2 = std::max(glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+			std::max(glm::dot(glm::vec3(model[1]), glm::vec3(model[1])), glm::dot(glm::vec3(model[2]), glm::vec3(model[2]))));
+
+		return glm::vec4(center, sphere.w * std::sqrt(scale2));
+	}
+
+	///////////////////////////////////////////////////
+	//	CullSpheres(const Frustum&, const glm::vec4*, GLuint, GLuint*)
+	//
+	//	frustum: planes to test against
+	//	spheres: world space centers in xyz, radii in w
+	//	count: number of spheres
+	//	visible: receives up to count indices
+	///////////////////////////////////////////////////
+	GLuint CullSpheres(const Frustum& frustum, const glm::vec4* spheres, GLuint count, GLuint* visible)
+	{
+		GLuint nVisible = 0;
+		GLuint i = 0;
+
+#ifdef SIMDMATH_SSE
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(&spheres[i][0]);
+			__m128 y = _mm_loadu_ps(&spheres[i + 1][0]);
+			__m128 z = _mm_loadu_ps(&spheres[i + 2][0]);
+			__m128 r = _mm_loadu_ps(&spheres[i + 3][0]);
+			_MM_TRANSPOSE4_PS(x, y, z, r);
+			__m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), r);
+
+			// lanes stay set while every plane has the sphere on its inner side
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (const glm::vec4& plane : frustum.planes)
+			{
+				__m128 distance = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+					_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+			}
+
+			int mask = _mm_movemask_ps(inside);
+			for (GLuint lane = 0; lane < 4; lane++)
+			{
+				if (mask & (1 << lane))
+					visible[nVisible++] = i + lane;
+			}
+		}
+#endif
+
+		for (; i < count; i++)
+		{
+			const glm::vec4& sphere = spheres[i];
+			bool inside = true;
+			for (const glm::vec4& plane : frustum.planes)
+			{
+				if (glm::dot(glm::vec3(plane), glm::vec3(sphere)) + plane.w < -sphere.w)
+				{
+					inside = false;
+					break;
+				}
+			}
+			if (inside)
+				visible[nVisible++] = i;
+		}
+
+		return nVisible;
+	}
+
+	///////////////////////////////////////////////////
+	//	ScreenRect(const glm::vec4&, const glm::mat4&, GLint, GLint, GLint[4])
+	//
+	//	Projects the corners of the sphere's bounding box,
+	//	which is conservative and cheap. A box reaching
+	//	behind the eye cannot be projected, so it covers
+	//	the whole viewport.
+	///////////////////////////////////////////////////
+	bool ScreenRect(const glm::vec4& sphere, const glm::mat4& viewProjection, GLint width, GLint height, GLint rect[4])
+	{
+		float minX = 1.0f, minY = 1.0f, maxX = -1.0f, maxY = -1.0f;
+		for (int corner = 0; corner < 8; corner++)
+		{
+			glm::vec4 point(sphere.x + ((corner & 1) ? sphere.w : -sphere.w),
+				sphere.y + ((corner & 2) ? sphere.w : -sphere.w),
+				sphere.z + ((corner & 4) ? sphere.w : -sphere.w), 1.0f);
+			glm::vec4 clip = viewProjection * point;
+			if (clip.w <= 0.0f)
+			{
+				rect[0] = 0;
+				rect[1] = 0;
+				rect[2] = width;
+				rect[3] = height;
+				return true;
+			}
+
+			float x = clip.x / clip.w;
+			float y = clip.y / clip.w;
+			minX = std::min(minX, x);
+			minY = std::min(minY, y);
+			maxX = std::max(maxX, x);
+			maxY = std::max(maxY, y);
+		}
+
+		minX = std::max(minX, -1.0f);
+		minY = std::max(minY, -1.0f);
+		maxX = std::min(maxX, 1.0f);
+		maxY = std::min(maxY, 1.0f);
+		if (minX >= maxX || minY >= maxY)
+			return false;
+
+		rect[0] = (GLint)std::floor((minX * 0.5f + 0.5f) * width);
+		rect[1] = (GLint)std::floor((minY * 0.5f + 0.5f) * height);
+		rect[2] = (GLint)std::ceil((maxX * 0.5f + 0.5f) * width) - rect[0];
+		rect[3] = (GLint)std::ceil((maxY * 0.5f + 0.5f) * height) - rect[1];
+		return rect[2] > 0 && rect[3] > 0;
+	}
+}
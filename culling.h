@@ -0,0 +1,35 @@
+///////////////////////////////////////////////////////////////////////////////
+// culling.h
+// ========
+// view-frustum culling of bounding spheres, four spheres per SSE test
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+// Six planes (left, right, bottom, top, near, far) as (normal, distance), normals pointing inward
+struct Frustum
+{
+	glm::vec4 planes[6];
+};
+
+namespace Culling
+{
+	// Planes of the clip volume of a projection * view matrix, in world space
+	Frustum ExtractFrustum(const glm::mat4& viewProjection);
+
+	// Move an object space bounding sphere to world space. The radius grows by the
+	// largest axis scale, so the sphere stays conservative under non-uniform scale.
+	glm::vec4 TransformSphere(const glm::mat4& model, const glm::vec4& sphere);
+
+	// Write the indices of the spheres that are at least partly inside the frustum
+	// to visible, and return how many there are
+	GLuint CullSpheres(const Frustum& frustum, const glm::vec4* spheres, GLuint count, GLuint* visible);
+
+	// Pixel rectangle (x, y, width, height) of a width x height viewport covering a
+	// world space sphere; false when the sphere is entirely off screen
+	bool ScreenRect(const glm::vec4& sphere, const glm::mat4& viewProjection, GLint width, GLint height, GLint rect[4]);
+}
@@ -0,0 +1,219 @@
+///////////////////////////////////////////////////////////////////////////////
+// dynamicresolution.cpp
+// ========
+// offscreen scene target whose size follows a GPU frame time target
+//
+// Most of a frame's GPU time goes to work per pixel, so the time is taken
+// to follow the square of the scale and a new scale is solved for from
+// the smoothed measurement. Changes are made in steps, only after a run of
+// frames measured at the current size, and going up needs some headroom
+// under the target, so the targets are recreated seldom and the scale
+// does not flicker around the target. Multisampling only adds renderbuffers
+// the scene is drawn into; everything after the resolve reads colorTexture
+// whatever the sample count.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "dynamicresolution.h"
+#include "glstate.h"
+#include "gputimer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// Frames measured at one size before it may change
+	const GLuint SETTLE_FRAMES = 30;
+	// Scales are multiples of it
+	const float SCALE_STEP = 0.05f;
+	// How far under the target the frame time must be before the scale goes up
+	const float HEADROOM = 1.15f;
+}
+
+///////////////////////////////////////////////////
+//	Create(GLsizei, GLsizei, float, float, float)
+//
+//	outputWidth, outputHeight: size of the window's framebuffer
+//	minScale, maxScale: bounds of the scale, in (0, 1]
+//	targetMilliseconds: GPU time a frame should take
+///////////////////////////////////////////////////
+bool DynamicResolution::Create(GLsizei outputWidth, GLsizei outputHeight, float minScale, float maxScale, float targetMilliseconds)
+{
+	this->minScale = minScale;
+	this->maxScale = maxScale;
+	this->targetMilliseconds = targetMilliseconds;
+	scale = maxScale;
+	return Resize(outputWidth, outputHeight);
+}
+
+void DynamicResolution::Destroy()
+{
+	UDestroyTargets();
+	outputWidth = 0;
+	outputHeight = 0;
+}
+
+bool DynamicResolution::Resize(GLsizei outputWidth, GLsizei outputHeight)
+{
+	this->outputWidth = outputWidth;
+	this->outputHeight = outputHeight;
+	mFrames = 0;
+	return UCreateTargets();
+}
+
+bool DynamicResolution::Update(float gpuMilliseconds)
+{
+	float wanted = maxScale;
+	if (enabled)
+	{
+		// the first results after a change were measured at the old size
+		if (gpuMilliseconds <= 0.0f || ++mFrames <= GpuTimer::LATENCY)
+			return false;
+		mAverage = mFrames == GpuTimer::LATENCY + 1 ? gpuMilliseconds : mAverage + (gpuMilliseconds - mAverage) * 0.1f;
+		if (mFrames < SETTLE_FRAMES)
+			return false;
+
+		float ratio = targetMilliseconds / mAverage;
+		if (ratio >= 1.0f && ratio < HEADROOM)
+		{
+			mFrames = 0;
+			return false;
+		}
+		wanted = scale * std::sqrt(ratio >= 1.0f ? ratio / HEADROOM : ratio);
+		wanted = std::floor(wanted / SCALE_STEP + 0.5f) * SCALE_STEP;
+		if (ratio < 1.0f)
+			wanted = std::min(wanted, scale - SCALE_STEP);	// over the target always gives way
+		wanted = std::min(std::max(wanted, minScale), maxScale);
+	}
+
+	mFrames = 0;
+	if (std::fabs(wanted - scale) < SCALE_STEP * 0.5f)
+		return false;
+
+	scale = wanted;
+	return UCreateTargets();
+}
+
+bool DynamicResolution::SetSamples(GLsizei samples)
+{
+	GLint maxSamples = 1;
+	glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+	samples = std::min(std::max(samples, 1), (GLsizei)maxSamples);
+	if (samples == this->samples)
+		return true;
+
+	this->samples = samples;
+	return UCreateTargets();
+}
+
+void DynamicResolution::BindForWriting() const
+{
+	gGLState.BindFramebuffer(GL_FRAMEBUFFER, samples > 1 ? multisampleFramebuffer : framebuffer);
+	gGLState.Viewport(0, 0, width, height);
+}
+
+void DynamicResolution::BindFilteredForWriting() const
+{
+	gGLState.BindFramebuffer(GL_FRAMEBUFFER, filteredFramebuffer);
+	gGLState.Viewport(0, 0, width, height);
+}
+
+void DynamicResolution::Resolve() const
+{
+	if (samples <= 1)
+		return;
+
+	gGLState.BindFramebuffer(GL_READ_FRAMEBUFFER, multisampleFramebuffer);
+	gGLState.BindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+}
+
+bool DynamicResolution::UCreateTargets()
+{
+	UDestroyTargets();
+	width = std::max((GLsizei)(outputWidth * scale + 0.5f), 1);
+	height = std::max((GLsizei)(outputHeight * scale + 0.5f), 1);
+
+	gGLState.ActiveTexture(GL_TEXTURE0);
+	glGenTextures(1, &colorTexture);
+	gGLState.BindTexture(GL_TEXTURE_2D, colorTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenTextures(1, &depthTexture);
+	gGLState.BindTexture(GL_TEXTURE_2D, depthTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	gGLState.BindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &framebuffer);
+	gGLState.BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+	glGenTextures(1, &filteredTexture);
+	gGLState.BindTexture(GL_TEXTURE_2D, filteredTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	gGLState.BindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &filteredFramebuffer);
+	gGLState.BindFramebuffer(GL_FRAMEBUFFER, filteredFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, filteredTexture, 0);
+	complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+	if (samples > 1)
+	{
+		glGenRenderbuffers(1, &mMultisampleColor);
+		glBindRenderbuffer(GL_RENDERBUFFER, mMultisampleColor);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+		glGenRenderbuffers(1, &mMultisampleDepth);
+		glBindRenderbuffer(GL_RENDERBUFFER, mMultisampleDepth);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT32F, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glGenFramebuffers(1, &multisampleFramebuffer);
+		gGLState.BindFramebuffer(GL_FRAMEBUFFER, multisampleFramebuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, mMultisampleColor);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mMultisampleDepth);
+		complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	}
+
+	gGLState.BindFramebuffer(GL_FRAMEBUFFER, 0);
+	return complete;
+}
+
+void DynamicResolution::UDestroyTargets()
+{
+	const GLuint framebuffers[] = { framebuffer, filteredFramebuffer, multisampleFramebuffer };
+	if (framebuffer)
+		gGLState.DeleteFramebuffers(multisampleFramebuffer ? 3 : 2, framebuffers);
+
+	const GLuint textures[] = { colorTexture, depthTexture, filteredTexture };
+	if (colorTexture)
+		gGLState.DeleteTextures(3, textures);
+
+	const GLuint renderbuffers[] = { mMultisampleColor, mMultisampleDepth };
+	if (mMultisampleColor)
+		glDeleteRenderbuffers(2, renderbuffers);
+
+	framebuffer = 0;
+	colorTexture = 0;
+	depthTexture = 0;
+	filteredFramebuffer = 0;
+	filteredTexture = 0;
+	multisampleFramebuffer = 0;
+	mMultisampleColor = 0;
+	mMultisampleDepth = 0;
+	width = 0;
+	height = 0;
+}
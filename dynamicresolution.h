@@ -0,0 +1,69 @@
+///////////////////////////////////////////////////////////////////////////////
+// dynamicresolution.h
+// ========
+// offscreen scene target whose size follows a GPU frame time target
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+// Color and depth the scene is drawn into at scale times the window's size on each
+// axis. The scale moves between minScale and maxScale to keep the measured GPU time
+// of a frame near targetMilliseconds; the result is upscaled to the window.
+// With samples above 1 the scene is drawn into multisampled buffers instead and
+// resolved into colorTexture.
+class DynamicResolution
+{
+public:
+	GLuint framebuffer = 0;
+	GLuint colorTexture = 0;	// GL_RGBA8, bilinear, sampled by the upscale pass
+	GLuint depthTexture = 0;	// GL_DEPTH_COMPONENT32F
+	GLuint filteredFramebuffer = 0;
+	GLuint filteredTexture = 0;	// GL_RGBA8 at the render size, for post-processing colorTexture
+	GLuint multisampleFramebuffer = 0;	// Only with samples above 1
+	GLsizei samples = 1;
+	GLsizei width = 0;			// Render size in pixels
+	GLsizei height = 0;
+	GLsizei outputWidth = 0;	// Size of the window's framebuffer
+	GLsizei outputHeight = 0;
+
+	float scale = 1.0f;
+	float minScale = 0.5f;
+	float maxScale = 1.0f;
+	float targetMilliseconds = 16.0f;
+	bool enabled = true;		// Off holds the scale at maxScale
+
+public:
+	bool Create(GLsizei outputWidth, GLsizei outputHeight, float minScale, float maxScale, float targetMilliseconds);
+	void Destroy();
+
+	// Follow a new window size at the current scale
+	bool Resize(GLsizei outputWidth, GLsizei outputHeight);
+
+	// Feed the GPU time of a recent frame, once per frame. Returns true when the
+	// render size changed and the targets were recreated.
+	bool Update(float gpuMilliseconds);
+
+	// Draw the scene with this many samples per pixel, clamped to what the GL allows
+	bool SetSamples(GLsizei samples);
+
+	// Render the scene into the targets
+	void BindForWriting() const;
+
+	// Render into filteredTexture, at the render size
+	void BindFilteredForWriting() const;
+
+	// Average the samples into colorTexture; nothing to do without multisampling
+	void Resolve() const;
+
+private:
+	GLuint mMultisampleColor = 0;	// Renderbuffers of multisampleFramebuffer
+	GLuint mMultisampleDepth = 0;
+
+	float mAverage = 0.0f;		// Smoothed frame time since the last change
+	GLuint mFrames = 0;			// Frames since the last change
+
+	bool UCreateTargets();
+	void UDestroyTargets();
+};
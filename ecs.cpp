@@ -0,0 +1,155 @@
+///////////////////////////////////////////////////////////////////////////////
+// ecs.cpp
+// ========
+// entities grouped by component set, stored as structure-of-arrays chunks
+//
+// Every distinct component set is an archetype owning a list of chunks.
+// A chunk keeps each component of its entities in one array, so a system
+// reading bounds walks packed spheres instead of striding over whole
+// objects, and chunks are independent units of work for parallel systems.
+// Components are plain data and move between rows with memcpy.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ecs.h"
+
+#include <cstring>
+
+namespace
+{
+	const size_t COMPONENT_SIZES[COMPONENT_COUNT] = {
+		sizeof(TransformComponent),
+		sizeof(MeshComponent),
+		sizeof(MaterialComponent),
+		sizeof(BoundsComponent),
+		sizeof(VisibilityComponent)
+	};
+
+	// Column starts are kept 16 byte aligned for SSE loads
+	size_t AlignUp(size_t value)
+	{
+		return (value + 15) & ~(size_t)15;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Create(ComponentMask)
+//
+//	mask: ComponentBit() of every component the entity has
+//
+//	Entities are numbered in creation order and their
+//	numbers are not reused
+///////////////////////////////////////////////////
+Entity EntityWorld::Create(ComponentMask mask)
+{
+	GLuint archetypeIndex = UFindArchetype(mask);
+	Archetype& archetype = mArchetypes[archetypeIndex];
+
+	if (archetype.chunks.empty() || archetype.chunks.back()->count == EntityChunk::CAPACITY)
+		archetype.chunks.push_back(UCreateChunk(mask));
+
+	EntityChunk& chunk = *archetype.chunks.back();
+	GLuint row = chunk.count++;
+
+	Entity entity = (Entity)mRecords.size();
+	chunk.entities[row] = entity;
+	for (GLuint type = 0; type < COMPONENT_COUNT; type++)
+	{
+		if (chunk.mColumns[type])
+			memset(chunk.mColumns[type] + row * COMPONENT_SIZES[type], 0, COMPONENT_SIZES[type]);
+	}
+
+	mRecords.push_back({ archetypeIndex, (GLuint)archetype.chunks.size() - 1, row, true });
+	mAlive++;
+	return entity;
+}
+
+void EntityWorld::Destroy(Entity entity)
+{
+	Record& record = mRecords[entity];
+	if (!record.alive)
+		return;
+
+	EntityChunk& chunk = *mArchetypes[record.archetype].chunks[record.chunk];
+	GLuint last = chunk.count - 1;
+
+	// fill the hole with the chunk's last entity
+	if (record.row != last)
+	{
+		for (GLuint type = 0; type < COMPONENT_COUNT; type++)
+		{
+			if (chunk.mColumns[type])
+				memcpy(chunk.mColumns[type] + record.row * COMPONENT_SIZES[type], chunk.mColumns[type] + last * COMPONENT_SIZES[type], COMPONENT_SIZES[type]);
+		}
+		Entity moved = chunk.entities[last];
+		chunk.entities[record.row] = moved;
+		mRecords[moved].row = record.row;
+	}
+
+	chunk.count--;
+	record.alive = false;
+	mAlive--;
+}
+
+void EntityWorld::Clear()
+{
+	mArchetypes.clear();
+	mRecords.clear();
+	mAlive = 0;
+}
+
+void EntityWorld::Query(ComponentMask mask, std::vector<EntityChunk*>& chunks)
+{
+	chunks.clear();
+	for (Archetype& archetype : mArchetypes)
+	{
+		if ((archetype.mask & mask) != mask)
+			continue;
+
+		for (std::unique_ptr<EntityChunk>& chunk : archetype.chunks)
+		{
+			if (chunk->count > 0)
+				chunks.push_back(chunk.get());
+		}
+	}
+}
+
+GLuint EntityWorld::UFindArchetype(ComponentMask mask)
+{
+	for (GLuint i = 0; i < mArchetypes.size(); i++)
+	{
+		if (mArchetypes[i].mask == mask)
+			return i;
+	}
+
+	mArchetypes.push_back(Archetype());
+	mArchetypes.back().mask = mask;
+	return (GLuint)mArchetypes.size() - 1;
+}
+
+// Allocate one block holding an array of CAPACITY entries for every component in mask
+std::unique_ptr<EntityChunk> EntityWorld::UCreateChunk(ComponentMask mask)
+{
+	std::unique_ptr<EntityChunk> chunk(new EntityChunk());
+
+	size_t offsets[COMPONENT_COUNT] = {};
+	size_t size = 0;
+	for (GLuint type = 0; type < COMPONENT_COUNT; type++)
+	{
+		if (mask & ComponentBit((ComponentType)type))
+		{
+			offsets[type] = size;
+			size = AlignUp(size + COMPONENT_SIZES[type] * EntityChunk::CAPACITY);
+		}
+	}
+
+	chunk->mStorage.resize(size + 15);
+	unsigned char* base = chunk->mStorage.data();
+	base += (16 - ((size_t)base & 15)) & 15;
+
+	for (GLuint type = 0; type < COMPONENT_COUNT; type++)
+	{
+		if (mask & ComponentBit((ComponentType)type))
+			chunk->mColumns[type] = base + offsets[type];
+	}
+	return chunk;
+}
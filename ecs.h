@@ -0,0 +1,158 @@
+///////////////////////////////////////////////////////////////////////////////
+// ecs.h
+// ========
+// entities grouped by component set, stored as structure-of-arrays chunks
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <vector>
+
+#include "meshes.h"
+#include "meshpool.h"
+#include "simdmath.h"
+
+typedef GLuint Entity;
+
+// Placement in the scene graph and the world matrices derived from it
+struct TransformComponent
+{
+	int node;					// Scene graph node placing the entity
+	glm::mat4 model;			// World transform, copied from the node when it changes
+	NormalMatrix normalMatrix;	// Inverse transpose of model, for normals
+	bool movable;				// Moves at runtime, so it is never baked into cached shadow maps
+};
+
+// What to draw
+struct MeshComponent
+{
+	const Meshes::GLMesh* mesh;
+	Meshes::DrawRange ranges[3];	// Drawing commands issued for the entity
+	int nRanges;
+	MeshPool::Range poolRange;		// The same triangles in the mesh pool
+	MeshPool::Range staticRange;	// The triangles' world space copy in the entity's static batch
+	GLuint staticBatch;				// 1 + index of the static batch, 0 when drawn on its own
+};
+
+// How to shade it
+struct MaterialComponent
+{
+	GLuint textureId;		// Texture array the object samples
+	GLuint textureIndex;	// Layer of textureId holding the object's texture
+	glm::vec3 color;
+	GLuint aoBase;			// Index of the entity's first baked AO value
+	bool twoSided;			// Thin surface, seen from both sides
+};
+
+// World space bounding sphere, center in xyz and radius in w
+struct BoundsComponent
+{
+	glm::vec4 sphere;
+};
+
+// Result of this frame's culling
+struct VisibilityComponent
+{
+	GLuint visible;
+};
+
+enum ComponentType
+{
+	COMPONENT_TRANSFORM,
+	COMPONENT_MESH,
+	COMPONENT_MATERIAL,
+	COMPONENT_BOUNDS,
+	COMPONENT_VISIBILITY,
+	COMPONENT_COUNT
+};
+
+typedef GLuint ComponentMask;
+
+template<typename T> struct ComponentId;
+template<> struct ComponentId<TransformComponent> { static const ComponentType value = COMPONENT_TRANSFORM; };
+template<> struct ComponentId<MeshComponent> { static const ComponentType value = COMPONENT_MESH; };
+template<> struct ComponentId<MaterialComponent> { static const ComponentType value = COMPONENT_MATERIAL; };
+template<> struct ComponentId<BoundsComponent> { static const ComponentType value = COMPONENT_BOUNDS; };
+template<> struct ComponentId<VisibilityComponent> { static const ComponentType value = COMPONENT_VISIBILITY; };
+
+inline ComponentMask ComponentBit(ComponentType type)
+{
+	return 1u << type;
+}
+
+// Fixed-capacity block of entities sharing one component set, each component in
+// its own contiguous array
+class EntityChunk
+{
+public:
+	static const GLuint CAPACITY = 128;
+
+	GLuint count = 0;
+	Entity entities[CAPACITY];
+
+public:
+	// First element of the component array, or nullptr when the chunk's archetype lacks it
+	template<typename T> T* Get() { return (T*)mColumns[ComponentId<T>::value]; }
+	template<typename T> const T* Get() const { return (const T*)mColumns[ComponentId<T>::value]; }
+
+private:
+	friend class EntityWorld;
+
+	unsigned char* mColumns[COMPONENT_COUNT] = {};
+	std::vector<unsigned char> mStorage;
+};
+
+class EntityWorld
+{
+public:
+	// Create an entity with the given components, zero initialized
+	Entity Create(ComponentMask mask);
+
+	// Remove an entity; the last entity of its chunk takes its row
+	void Destroy(Entity entity);
+
+	void Clear();
+
+	// The entity's component, or nullptr when it has none of that type
+	template<typename T> T* Get(Entity entity)
+	{
+		const Record& record = mRecords[entity];
+		if (!record.alive)
+			return nullptr;
+		T* column = mArchetypes[record.archetype].chunks[record.chunk]->Get<T>();
+		return column ? column + record.row : nullptr;
+	}
+
+	// Chunks of every archetype having at least the components in mask, in creation order
+	void Query(ComponentMask mask, std::vector<EntityChunk*>& chunks);
+
+	GLuint Size() const { return mAlive; }
+
+private:
+	struct Archetype
+	{
+		ComponentMask mask;
+		std::vector<std::unique_ptr<EntityChunk>> chunks;
+	};
+
+	// Where an entity's components live
+	struct Record
+	{
+		GLuint archetype;
+		GLuint chunk;
+		GLuint row;
+		bool alive;
+	};
+
+	std::vector<Archetype> mArchetypes;
+	std::vector<Record> mRecords;
+	GLuint mAlive = 0;
+
+	GLuint UFindArchetype(ComponentMask mask);
+	static std::unique_ptr<EntityChunk> UCreateChunk(ComponentMask mask);
+};
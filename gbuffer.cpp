@@ -0,0 +1,97 @@
+///////////////////////////////////////////////////////////////////////////////
+// gbuffer.cpp
+// ========
+// render targets of the deferred geometry pass
+//
+// Two color targets and depth come to 12 bytes per pixel. Normals are
+// folded onto an octahedron and stored as two signed 16 bit values, which
+// keeps them well below a degree of error without a third channel, and
+// no position target is stored since the lighting pass recovers it from
+// depth and the inverse view projection.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "gbuffer.h"
+#include "glstate.h"
+
+namespace
+{
+	GLuint CreateTarget(GLenum internalFormat, GLenum format, GLenum type, GLsizei width, GLsizei height)
+	{
+		GLuint texture;
+		glGenTextures(1, &texture);
+		gGLState.BindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
+		// read back with texelFetch(), one texel per pixel
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		return texture;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Create(GLsizei, GLsizei)
+//
+//	width, height: size of the targets in pixels,
+//	normally the size of the window
+///////////////////////////////////////////////////
+bool GBuffer::Create(GLsizei width, GLsizei height)
+{
+	Destroy();
+	this->width = width;
+	this->height = height;
+
+	gGLState.ActiveTexture(GL_TEXTURE0);
+	albedoTexture = CreateTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+	normalTexture = CreateTarget(GL_RG16_SNORM, GL_RG, GL_SHORT, width, height);
+	depthTexture = CreateTarget(GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT, width, height);
+	gGLState.BindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &framebuffer);
+	gGLState.BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+
+	const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, drawBuffers);
+
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	gGLState.BindFramebuffer(GL_FRAMEBUFFER, 0);
+	return complete;
+}
+
+void GBuffer::Destroy()
+{
+	if (framebuffer)
+		gGLState.DeleteFramebuffers(1, &framebuffer);
+
+	const GLuint textures[] = { albedoTexture, normalTexture, depthTexture };
+	if (albedoTexture)
+		gGLState.DeleteTextures(3, textures);
+
+	framebuffer = 0;
+	albedoTexture = 0;
+	normalTexture = 0;
+	depthTexture = 0;
+	width = 0;
+	height = 0;
+}
+
+void GBuffer::BindForWriting() const
+{
+	gGLState.BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	gGLState.Viewport(0, 0, width, height);
+}
+
+void GBuffer::BindTextures() const
+{
+	gGLState.ActiveTexture(GL_TEXTURE0 + ALBEDO_UNIT);
+	gGLState.BindTexture(GL_TEXTURE_2D, albedoTexture);
+	gGLState.ActiveTexture(GL_TEXTURE0 + NORMAL_UNIT);
+	gGLState.BindTexture(GL_TEXTURE_2D, normalTexture);
+	gGLState.ActiveTexture(GL_TEXTURE0 + DEPTH_UNIT);
+	gGLState.BindTexture(GL_TEXTURE_2D, depthTexture);
+	gGLState.ActiveTexture(GL_TEXTURE0);
+}
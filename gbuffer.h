@@ -0,0 +1,37 @@
+///////////////////////////////////////////////////////////////////////////////
+// gbuffer.h
+// ========
+// render targets of the deferred geometry pass
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+// Albedo with baked AO, octahedral normals and depth, the least a lighting pass
+// needs to shade a pixel. World position is rebuilt from depth.
+class GBuffer
+{
+public:
+	// Texture units the lighting pass samples the targets from
+	static const GLuint ALBEDO_UNIT = 0;
+	static const GLuint NORMAL_UNIT = 1;
+	static const GLuint DEPTH_UNIT = 2;
+
+	GLuint framebuffer = 0;
+	GLuint albedoTexture = 0;	// GL_RGBA8: albedo in rgb, ambient occlusion in a
+	GLuint normalTexture = 0;	// GL_RG16_SNORM: world space normal, octahedral encoded
+	GLuint depthTexture = 0;	// GL_DEPTH_COMPONENT32F
+	GLsizei width = 0;
+	GLsizei height = 0;
+
+public:
+	// (Re)create the targets at the given size
+	bool Create(GLsizei width, GLsizei height);
+	void Destroy();
+
+	// Render into the targets
+	void BindForWriting() const;
+	// Bind the targets to their texture units
+	void BindTextures() const;
+};
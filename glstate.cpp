@@ -0,0 +1,322 @@
+///////////////////////////////////////////////////////////////////////////////
+// glstate.cpp
+// ========
+// shadow copy of the GL binding and capability state, dropping redundant calls
+//
+// Every setter compares against the last value it sent and only calls GL
+// when the value differs. State starts out unknown, so the first call of
+// each kind always goes through. All binds of the program must use this
+// layer for the shadow copy to stay true; Invalidate() recovers after
+// direct GL calls.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "glstate.h"
+
+GLState gGLState;
+
+namespace
+{
+	GLuint64 PairKey(GLuint high, GLuint low)
+	{
+		return ((GLuint64)high << 32) | low;
+	}
+}
+
+void GLState::BeginFrame()
+{
+	lastFrame = frame;
+	frame = GLStateStats();
+}
+
+void GLState::Invalidate()
+{
+	mCapabilities.clear();
+	mClearColorKnown = false;
+	mViewportKnown = false;
+	mDepthFunc = UNKNOWN;
+	mDepthMask = UNKNOWN;
+	mColorMask = UNKNOWN;
+	mBlendSource = UNKNOWN;
+	mBlendDestination = UNKNOWN;
+	mScissorKnown = false;
+	mPolygonOffsetKnown = false;
+	mProgram = UNKNOWN;
+	mVao = UNKNOWN;
+	mDrawFramebuffer = UNKNOWN;
+	mReadFramebuffer = UNKNOWN;
+	mActiveUnit = UNKNOWN;
+	mTextures.clear();
+	mBuffers.clear();
+	mIndexedBuffers.clear();
+}
+
+void GLState::Enable(GLenum capability)
+{
+	auto found = mCapabilities.find(capability);
+	if (UCount(found == mCapabilities.end() || !found->second))
+	{
+		glEnable(capability);
+		mCapabilities[capability] = true;
+	}
+}
+
+void GLState::Disable(GLenum capability)
+{
+	auto found = mCapabilities.find(capability);
+	if (UCount(found == mCapabilities.end() || found->second))
+	{
+		glDisable(capability);
+		mCapabilities[capability] = false;
+	}
+}
+
+void GLState::ClearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a)
+{
+	bool same = mClearColorKnown && mClearColor[0] == r && mClearColor[1] == g && mClearColor[2] == b && mClearColor[3] == a;
+	if (UCount(!same))
+	{
+		glClearColor(r, g, b, a);
+		mClearColor[0] = r; mClearColor[1] = g; mClearColor[2] = b; mClearColor[3] = a;
+		mClearColorKnown = true;
+	}
+}
+
+void GLState::Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	bool same = mViewportKnown && mViewport[0] == x && mViewport[1] == y && mViewport[2] == width && mViewport[3] == height;
+	if (UCount(!same))
+	{
+		glViewport(x, y, width, height);
+		mViewport[0] = x; mViewport[1] = y; mViewport[2] = width; mViewport[3] = height;
+		mViewportKnown = true;
+	}
+}
+
+void GLState::DepthFunc(GLenum func)
+{
+	if (UCount(mDepthFunc != func))
+	{
+		glDepthFunc(func);
+		mDepthFunc = func;
+	}
+}
+
+void GLState::DepthMask(GLboolean write)
+{
+	GLuint mask = write ? 1 : 0;
+	if (UCount(mDepthMask != mask))
+	{
+		glDepthMask(write);
+		mDepthMask = mask;
+	}
+}
+
+void GLState::ColorMask(GLboolean r, GLboolean g, GLboolean b, GLboolean a)
+{
+	GLuint mask = (r ? 1 : 0) | (g ? 2 : 0) | (b ? 4 : 0) | (a ? 8 : 0);
+	if (UCount(mColorMask != mask))
+	{
+		glColorMask(r, g, b, a);
+		mColorMask = mask;
+	}
+}
+
+void GLState::BlendFunc(GLenum source, GLenum destination)
+{
+	if (UCount(mBlendSource != source || mBlendDestination != destination))
+	{
+		glBlendFunc(source, destination);
+		mBlendSource = source;
+		mBlendDestination = destination;
+	}
+}
+
+void GLState::Scissor(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	bool same = mScissorKnown && mScissor[0] == x && mScissor[1] == y && mScissor[2] == width && mScissor[3] == height;
+	if (UCount(!same))
+	{
+		glScissor(x, y, width, height);
+		mScissor[0] = x; mScissor[1] = y; mScissor[2] = width; mScissor[3] = height;
+		mScissorKnown = true;
+	}
+}
+
+void GLState::PolygonOffset(GLfloat factor, GLfloat units)
+{
+	bool same = mPolygonOffsetKnown && mPolygonOffset[0] == factor && mPolygonOffset[1] == units;
+	if (UCount(!same))
+	{
+		glPolygonOffset(factor, units);
+		mPolygonOffset[0] = factor; mPolygonOffset[1] = units;
+		mPolygonOffsetKnown = true;
+	}
+}
+
+void GLState::UseProgram(GLuint program)
+{
+	if (UCount(mProgram != program))
+	{
+		glUseProgram(program);
+		mProgram = program;
+	}
+}
+
+void GLState::BindFramebuffer(GLenum target, GLuint framebuffer)
+{
+	bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+	bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+	bool changed = (draw && mDrawFramebuffer != framebuffer) || (read && mReadFramebuffer != framebuffer);
+	if (UCount(changed))
+	{
+		glBindFramebuffer(target, framebuffer);
+		if (draw)
+			mDrawFramebuffer = framebuffer;
+		if (read)
+			mReadFramebuffer = framebuffer;
+	}
+}
+
+void GLState::BindVertexArray(GLuint vao)
+{
+	if (UCount(mVao != vao))
+	{
+		glBindVertexArray(vao);
+		mVao = vao;
+	}
+}
+
+void GLState::ActiveTexture(GLenum unit)
+{
+	if (UCount(mActiveUnit != unit))
+	{
+		glActiveTexture(unit);
+		mActiveUnit = unit;
+	}
+}
+
+void GLState::BindTexture(GLenum target, GLuint texture)
+{
+	// bindings are per unit, so nothing can be filtered while the unit is unknown
+	if (mActiveUnit == UNKNOWN)
+	{
+		UCount(true);
+		glBindTexture(target, texture);
+		return;
+	}
+
+	GLuint64 key = PairKey(mActiveUnit, target);
+	auto found = mTextures.find(key);
+	if (UCount(found == mTextures.end() || found->second != texture))
+	{
+		glBindTexture(target, texture);
+		mTextures[key] = texture;
+	}
+}
+
+void GLState::BindBuffer(GLenum target, GLuint buffer)
+{
+	if (target == GL_ELEMENT_ARRAY_BUFFER)
+	{
+		UCount(true);
+		glBindBuffer(target, buffer);
+		return;
+	}
+
+	auto found = mBuffers.find(target);
+	if (UCount(found == mBuffers.end() || found->second != buffer))
+	{
+		glBindBuffer(target, buffer);
+		mBuffers[target] = buffer;
+	}
+}
+
+void GLState::BindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+	GLuint64 key = PairKey(target, index);
+	auto found = mIndexedBuffers.find(key);
+	if (UCount(found == mIndexedBuffers.end() || found->second != buffer))
+	{
+		glBindBufferBase(target, index, buffer);
+		mIndexedBuffers[key] = buffer;
+		mBuffers[target] = buffer;	// also replaces the generic binding
+	}
+}
+
+void GLState::BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	UCount(true);
+	glBindBufferRange(target, index, buffer, offset, size);
+	mIndexedBuffers[PairKey(target, index)] = UNKNOWN;	// a later whole-buffer bind must go through
+	mBuffers[target] = buffer;
+}
+
+void GLState::DeleteProgram(GLuint program)
+{
+	glDeleteProgram(program);
+	if (mProgram == program)
+		mProgram = UNKNOWN;
+}
+
+void GLState::DeleteVertexArrays(GLsizei n, const GLuint* vaos)
+{
+	glDeleteVertexArrays(n, vaos);
+	for (GLsizei i = 0; i < n; i++)
+	{
+		if (mVao == vaos[i])
+			mVao = UNKNOWN;
+	}
+}
+
+void GLState::DeleteTextures(GLsizei n, const GLuint* textures)
+{
+	glDeleteTextures(n, textures);
+	for (GLsizei i = 0; i < n; i++)
+	{
+		for (auto& binding : mTextures)
+		{
+			if (binding.second == textures[i])
+				binding.second = 0;
+		}
+	}
+}
+
+void GLState::DeleteBuffers(GLsizei n, const GLuint* buffers)
+{
+	glDeleteBuffers(n, buffers);
+	for (GLsizei i = 0; i < n; i++)
+	{
+		for (auto& binding : mBuffers)
+		{
+			if (binding.second == buffers[i])
+				binding.second = 0;
+		}
+		for (auto& binding : mIndexedBuffers)
+		{
+			if (binding.second == buffers[i])
+				binding.second = 0;
+		}
+	}
+}
+
+void GLState::DeleteFramebuffers(GLsizei n, const GLuint* framebuffers)
+{
+	glDeleteFramebuffers(n, framebuffers);
+	for (GLsizei i = 0; i < n; i++)
+	{
+		if (mDrawFramebuffer == framebuffers[i])
+			mDrawFramebuffer = UNKNOWN;
+		if (mReadFramebuffer == framebuffers[i])
+			mReadFramebuffer = UNKNOWN;
+	}
+}
+
+// Count a call as issued when the state changes, as filtered otherwise
+bool GLState::UCount(bool changed)
+{
+	if (changed)
+		frame.issued++;
+	else
+		frame.filtered++;
+	return changed;
+}
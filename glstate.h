@@ -0,0 +1,95 @@
+///////////////////////////////////////////////////////////////////////////////
+// glstate.h
+// ========
+// shadow copy of the GL binding and capability state, dropping redundant calls
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <unordered_map>
+
+// Calls that reached the driver and calls dropped as no-ops
+struct GLStateStats
+{
+	GLuint issued = 0;
+	GLuint filtered = 0;
+};
+
+class GLState
+{
+public:
+	GLStateStats frame;		// Counters of the frame in progress
+	GLStateStats lastFrame;	// Counters of the last complete frame
+
+public:
+	// Close the current frame's counters and start new ones
+	void BeginFrame();
+
+	// Forget everything, for code that changed state behind the cache's back
+	void Invalidate();
+
+	void Enable(GLenum capability);
+	void Disable(GLenum capability);
+	void ClearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a);
+	void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+	void DepthFunc(GLenum func);
+	void DepthMask(GLboolean write);
+	void ColorMask(GLboolean r, GLboolean g, GLboolean b, GLboolean a);
+	void BlendFunc(GLenum source, GLenum destination);
+	void Scissor(GLint x, GLint y, GLsizei width, GLsizei height);
+	void PolygonOffset(GLfloat factor, GLfloat units);
+
+	void UseProgram(GLuint program);
+	// GL_FRAMEBUFFER sets both the draw and the read binding
+	void BindFramebuffer(GLenum target, GLuint framebuffer);
+	void BindVertexArray(GLuint vao);
+	void ActiveTexture(GLenum unit);
+	void BindTexture(GLenum target, GLuint texture);
+
+	// GL_ELEMENT_ARRAY_BUFFER belongs to the bound VAO and always goes through
+	void BindBuffer(GLenum target, GLuint buffer);
+	void BindBufferBase(GLenum target, GLuint index, GLuint buffer);
+	// Ranges of streamed data move every frame, so this always goes through
+	void BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+	// Delete objects and clear any cached binding of their names, which GL may reuse
+	void DeleteProgram(GLuint program);
+	void DeleteVertexArrays(GLsizei n, const GLuint* vaos);
+	void DeleteTextures(GLsizei n, const GLuint* textures);
+	void DeleteBuffers(GLsizei n, const GLuint* buffers);
+	void DeleteFramebuffers(GLsizei n, const GLuint* framebuffers);
+
+private:
+	static const GLuint UNKNOWN = 0xFFFFFFFF;
+
+	std::unordered_map<GLenum, bool> mCapabilities;
+	GLfloat mClearColor[4] = {};
+	bool mClearColorKnown = false;
+	GLint mViewport[4] = {};
+	bool mViewportKnown = false;
+	GLenum mDepthFunc = UNKNOWN;
+	GLuint mDepthMask = UNKNOWN;
+	GLuint mColorMask = UNKNOWN;		// One bit per channel, r in bit 0
+	GLenum mBlendSource = UNKNOWN;
+	GLenum mBlendDestination = UNKNOWN;
+	GLint mScissor[4] = {};
+	bool mScissorKnown = false;
+	GLfloat mPolygonOffset[2] = {};
+	bool mPolygonOffsetKnown = false;
+
+	GLuint mProgram = UNKNOWN;
+	GLuint mVao = UNKNOWN;
+	GLuint mDrawFramebuffer = UNKNOWN;
+	GLuint mReadFramebuffer = UNKNOWN;
+	GLuint mActiveUnit = UNKNOWN;
+	std::unordered_map<GLuint64, GLuint> mTextures;			// (unit, target) -> texture
+	std::unordered_map<GLenum, GLuint> mBuffers;				// target -> buffer
+	std::unordered_map<GLuint64, GLuint> mIndexedBuffers;		// (target, index) -> buffer
+
+	bool UCount(bool changed);
+};
+
+// The state of the one GL context the application renders with
+extern GLState gGLState;
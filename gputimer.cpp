@@ -0,0 +1,58 @@
+///////////////////////////////////////////////////////////////////////////////
+// gputimer.cpp
+// ========
+// GPU time of a span of commands, measured with timer queries
+//
+// Each span is measured with a pair of GL_TIMESTAMP queries from a small
+// ring. Unlike GL_TIME_ELAPSED queries, timestamps can be taken inside
+// another timer's span, so a whole frame can be timed around its passes.
+// A query is only read back when its slot comes around again, by which
+// time the GPU has long finished it, so reading never stalls the CPU on
+// the frame still being drawn.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "gputimer.h"
+
+bool GpuTimer::Create()
+{
+	glGenQueries(LATENCY * 2, &mQueries[0][0]);
+	for (GLuint i = 0; i < LATENCY; i++)
+		mPending[i] = false;
+	mCurrent = 0;
+	mMilliseconds = 0.0f;
+	return mQueries[0][0] != 0;
+}
+
+void GpuTimer::Destroy()
+{
+	glDeleteQueries(LATENCY * 2, &mQueries[0][0]);
+	for (GLuint i = 0; i < LATENCY; i++)
+	{
+		mQueries[i][0] = mQueries[i][1] = 0;
+		mPending[i] = false;
+	}
+}
+
+void GpuTimer::Begin()
+{
+	GLuint* queries = mQueries[mCurrent];
+
+	// collect the result this slot held before reusing it
+	if (mPending[mCurrent])
+	{
+		GLuint64 start = 0, end = 0;
+		glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &end);
+		mMilliseconds = (end - start) / 1000000.0f;
+		mPending[mCurrent] = false;
+	}
+
+	glQueryCounter(queries[0], GL_TIMESTAMP);
+}
+
+void GpuTimer::End()
+{
+	glQueryCounter(mQueries[mCurrent][1], GL_TIMESTAMP);
+	mPending[mCurrent] = true;
+	mCurrent = (mCurrent + 1) % LATENCY;
+}
@@ -0,0 +1,33 @@
+///////////////////////////////////////////////////////////////////////////////
+// gputimer.h
+// ========
+// GPU time of a span of commands, measured with timer queries
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+class GpuTimer
+{
+public:
+	// Frames a query waits before its result is read
+	static const GLuint LATENCY = 3;
+
+public:
+	bool Create();
+	void Destroy();
+
+	// Bracket the commands to time; spans of different timers may nest
+	void Begin();
+	void End();
+
+	// GPU time of the span LATENCY frames ago, in milliseconds
+	float Milliseconds() const { return mMilliseconds; }
+
+private:
+	GLuint mQueries[LATENCY][2] = {};	// Timestamps of the start and the end of each span
+	bool mPending[LATENCY] = {};
+	GLuint mCurrent = 0;
+	float mMilliseconds = 0.0f;
+};
@@ -0,0 +1,103 @@
+///////////////////////////////////////////////////////////////////////////////
+// jobsystem.cpp
+// ========
+// persistent worker threads running parallel-for loops
+//
+// Workers sleep until a new loop is published, then take indices from a
+// shared atomic counter until it runs past the end, so uneven jobs balance
+// themselves. The caller works on the same loop and waits for every worker
+// to leave it before returning, which keeps the job object alive for as
+// long as anyone can still read it.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "jobsystem.h"
+
+void JobSystem::Start(GLuint nThreads)
+{
+	Stop();
+
+	if (nThreads == 0)
+	{
+		GLuint hardware = std::thread::hardware_concurrency();
+		nThreads = hardware > 1 ? hardware - 1 : 0;
+	}
+
+	// workers are handed the current generation so a loop published before
+	// they first take the lock is not missed
+	mQuit = false;
+	for (GLuint i = 0; i < nThreads; i++)
+		mThreads.emplace_back(&JobSystem::UWorker, this, mGeneration);
+}
+
+void JobSystem::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWake.notify_all();
+
+	for (std::thread& thread : mThreads)
+		thread.join();
+	mThreads.clear();
+}
+
+///////////////////////////////////////////////////
+//	ParallelFor(GLuint, const std::function<void(GLuint)>&)
+//
+//	count: number of job indices
+//	job: called once per index, from any thread
+///////////////////////////////////////////////////
+void JobSystem::ParallelFor(GLuint count, const std::function<void(GLuint)>& job)
+{
+	// not worth waking anyone for a single job
+	if (mThreads.empty() || count <= 1)
+	{
+		for (GLuint i = 0; i < count; i++)
+			job(i);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mJob = &job;
+		mCount = count;
+		mNext = 0;
+		mBusy = (GLuint)mThreads.size();
+		mGeneration++;
+	}
+	mWake.notify_all();
+
+	URunJobs();
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	mDone.wait(lock, [this]() { return mBusy == 0; });
+	mJob = nullptr;
+}
+
+void JobSystem::UWorker(GLuint seen)
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+
+	while (true)
+	{
+		mWake.wait(lock, [&]() { return mQuit || mGeneration != seen; });
+		if (mQuit)
+			return;
+		seen = mGeneration;
+
+		lock.unlock();
+		URunJobs();
+		lock.lock();
+
+		if (--mBusy == 0)
+			mDone.notify_one();
+	}
+}
+
+void JobSystem::URunJobs()
+{
+	GLuint i;
+	while ((i = mNext.fetch_add(1)) < mCount)
+		(*mJob)(i);
+}
@@ -0,0 +1,48 @@
+///////////////////////////////////////////////////////////////////////////////
+// jobsystem.h
+// ========
+// persistent worker threads running parallel-for loops
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem
+{
+public:
+	// Start nThreads workers, 0 uses every hardware thread but the caller's
+	void Start(GLuint nThreads = 0);
+	void Stop();
+
+	// Run job(i) for every i in [0, count) on the workers and the calling thread,
+	// returning once all of them are done. Jobs must not call ParallelFor().
+	void ParallelFor(GLuint count, const std::function<void(GLuint)>& job);
+
+	GLuint ThreadCount() const { return (GLuint)mThreads.size(); }
+
+	~JobSystem() { Stop(); }
+
+private:
+	std::vector<std::thread> mThreads;
+	std::mutex mMutex;
+	std::condition_variable mWake;
+	std::condition_variable mDone;
+
+	const std::function<void(GLuint)>* mJob = nullptr;
+	GLuint mCount = 0;
+	std::atomic<GLuint> mNext{ 0 };
+	GLuint mBusy = 0;			// Workers still inside the current loop
+	GLuint mGeneration = 0;		// Incremented for every loop, wakes the workers
+	bool mQuit = false;
+
+	void UWorker(GLuint seen);
+	void URunJobs();
+};
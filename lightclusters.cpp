@@ -0,0 +1,296 @@
+///////////////////////////////////////////////////////////////////////////////
+// lightclusters.cpp
+// ========
+// point lights binned into a view space cluster grid for forward shading
+//
+// The view frustum is cut into screen tiles and exponentially spaced depth
+// slices, so clusters stay roughly cubic from near to far. Each frame the
+// lights are moved to view space and every depth slice, in parallel,
+// gathers the lights whose depth range crosses it and tests them four at
+// a time against the bounding box of each of its clusters. The fragment
+// shader finds its cluster from its pixel and view depth and only loops
+// over that cluster's lights.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "lightclusters.h"
+#include "glstate.h"
+#include "simdmath.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef SIMDMATH_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+	// Stands in for the radius of lights without one; its square still fits a float
+	const float UNBOUNDED_RADIUS = 1.0e18f;
+}
+
+///////////////////////////////////////////////////
+//	Create(GLuint, GLuint)
+//
+//	maxLights: most lights one Build() uploads
+//	maxIndices: most light to cluster assignments;
+//	clusters past the limit lose their lights
+///////////////////////////////////////////////////
+bool LightClusters::Create(GLuint maxLights, GLuint maxIndices)
+{
+	lightCapacity = maxLights;
+	indexCapacity = maxIndices;
+
+	glGenBuffers(1, &lightBuffer);
+	gGLState.BindBuffer(GL_SHADER_STORAGE_BUFFER, lightBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(PointLight) * maxLights, NULL, GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &clusterBuffer);
+	gGLState.BindBuffer(GL_SHADER_STORAGE_BUFFER, clusterBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * 2 * CLUSTER_COUNT, NULL, GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &indexBuffer);
+	gGLState.BindBuffer(GL_SHADER_STORAGE_BUFFER, indexBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * maxIndices, NULL, GL_DYNAMIC_DRAW);
+	gGLState.BindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	gGLState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_BINDING, lightBuffer);
+	gGLState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_BINDING, clusterBuffer);
+	gGLState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, INDEX_BINDING, indexBuffer);
+	gGLState.BindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	mSliceLights.resize(GRID_Z);
+	mSliceIndices.resize(GRID_Z);
+	mClusters.resize(2 * CLUSTER_COUNT);
+
+	return lightBuffer != 0 && clusterBuffer != 0 && indexBuffer != 0;
+}
+
+void LightClusters::Destroy()
+{
+	const GLuint buffers[] = { lightBuffer, clusterBuffer, indexBuffer };
+	gGLState.DeleteBuffers(3, buffers);
+	lightBuffer = 0;
+	clusterBuffer = 0;
+	indexBuffer = 0;
+	lightCapacity = 0;
+	indexCapacity = 0;
+}
+
+void LightClusters::Build(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+	float nearPlane, float farPlane, JobSystem& jobs)
+{
+	if (projection != mProjection || nearPlane != mNear || farPlane != mFar)
+		UComputeBounds(projection, nearPlane, farPlane);
+
+	nLights = std::min<GLuint>((GLuint)lights.size(), lightCapacity);
+	mViewSpheres.resize(nLights);
+	for (GLuint i = 0; i < nLights; i++)
+	{
+		const PointLight& light = lights[i];
+		glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+		mViewSpheres[i] = glm::vec4(center, light.radius > 0.0f ? light.radius : UNBOUNDED_RADIUS);
+	}
+
+	jobs.ParallelFor(GRID_Z, [this](GLuint slice) { UAssignSlice(slice); });
+
+	// slice lists go back to back; clusters past the capacity lose their lights
+	nIndices = 0;
+	mIndices.clear();
+	for (GLuint slice = 0; slice < GRID_Z; slice++)
+	{
+		GLuint base = (GLuint)mIndices.size();
+		const std::vector<GLuint>& sliceIndices = mSliceIndices[slice];
+		nIndices += (GLuint)sliceIndices.size();
+
+		GLuint room = indexCapacity - base;
+		GLuint copied = std::min<GLuint>((GLuint)sliceIndices.size(), room);
+		mIndices.insert(mIndices.end(), sliceIndices.begin(), sliceIndices.begin() + copied);
+
+		for (GLuint tile = 0; tile < TILE_COUNT; tile++)
+		{
+			GLuint* cluster = &mClusters[2 * (slice * TILE_COUNT + tile)];
+			GLuint first = std::min(cluster[0], copied);
+			cluster[1] = std::min(cluster[1], copied - first);
+			cluster[0] = base + first;
+		}
+	}
+
+	gGLState.BindBuffer(GL_SHADER_STORAGE_BUFFER, lightBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(PointLight) * nLights, lights.data());
+	gGLState.BindBuffer(GL_SHADER_STORAGE_BUFFER, clusterBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint) * mClusters.size(), mClusters.data());
+	gGLState.BindBuffer(GL_SHADER_STORAGE_BUFFER, indexBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint) * mIndices.size(), mIndices.data());
+	gGLState.BindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+glm::vec2 LightClusters::DepthParameters() const
+{
+	return glm::vec2(mNear, GRID_Z / std::log(mFar / mNear));
+}
+
+// View depth of the near boundary of a slice; slice GRID_Z is the far plane
+float LightClusters::USliceDepth(GLuint slice) const
+{
+	return mNear * std::pow(mFar / mNear, (float)slice / GRID_Z);
+}
+
+///////////////////////////////////////////////////
+//	UComputeBounds(const glm::mat4&, float, float)
+//
+//	The edges of a tile are lines through the unprojected
+//	tile corners on the near and far planes; cutting them
+//	at a slice's two depths gives eight points whose box
+//	bounds the cluster, for perspective and orthographic
+//	projections alike
+///////////////////////////////////////////////////
+void LightClusters::UComputeBounds(const glm::mat4& projection, float nearPlane, float farPlane)
+{
+	mProjection = projection;
+	mNear = nearPlane;
+	mFar = farPlane;
+
+	for (std::vector<float>* bounds : { &mMinX, &mMinY, &mMinZ, &mMaxX, &mMaxY, &mMaxZ })
+		bounds->resize(CLUSTER_COUNT);
+
+	glm::mat4 inverse = glm::inverse(projection);
+	auto unproject = [&inverse](float x, float y, float z)
+	{
+		glm::vec4 point = inverse * glm::vec4(x, y, z, 1.0f);
+		return glm::vec3(point) * (1.0f / point.w);
+	};
+
+	for (GLuint tile = 0; tile < TILE_COUNT; tile++)
+	{
+		float x0 = -1.0f + 2.0f * (tile % GRID_X) / GRID_X;
+		float x1 = -1.0f + 2.0f * (tile % GRID_X + 1) / GRID_X;
+		float y0 = -1.0f + 2.0f * (tile / GRID_X) / GRID_Y;
+		float y1 = -1.0f + 2.0f * (tile / GRID_X + 1) / GRID_Y;
+
+		glm::vec3 nearCorners[4] = { unproject(x0, y0, -1.0f), unproject(x1, y0, -1.0f), unproject(x0, y1, -1.0f), unproject(x1, y1, -1.0f) };
+		glm::vec3 farCorners[4] = { unproject(x0, y0, 1.0f), unproject(x1, y0, 1.0f), unproject(x0, y1, 1.0f), unproject(x1, y1, 1.0f) };
+
+		for (GLuint slice = 0; slice < GRID_Z; slice++)
+		{
+			float depths[2] = { USliceDepth(slice), USliceDepth(slice + 1) };
+			glm::vec3 boxMin(1.0e30f), boxMax(-1.0e30f);
+
+			for (int corner = 0; corner < 4; corner++)
+			{
+				glm::vec3 edge = farCorners[corner] - nearCorners[corner];
+				for (float depth : depths)
+				{
+					// view space looks down -z, so depth d is at z == -d
+					float t = (-depth - nearCorners[corner].z) / edge.z;
+					glm::vec3 point = nearCorners[corner] + edge * t;
+					boxMin = glm::min(boxMin, point);
+					boxMax = glm::max(boxMax, point);
+				}
+			}
+
+			GLuint cluster = slice * TILE_COUNT + tile;
+			mMinX[cluster] = boxMin.x; mMinY[cluster] = boxMin.y; mMinZ[cluster] = boxMin.z;
+			mMaxX[cluster] = boxMax.x; mMaxY[cluster] = boxMax.y; mMaxZ[cluster] = boxMax.z;
+		}
+	}
+}
+
+///////////////////////////////////////////////////
+//	UAssignSlice(GLuint)
+//
+//	Runs on any thread; only touches the slice's own
+//	lists and cluster entries
+///////////////////////////////////////////////////
+void LightClusters::UAssignSlice(GLuint slice)
+{
+	float nearDepth = USliceDepth(slice);
+	float farDepth = USliceDepth(slice + 1);
+
+	// lights whose depth range crosses the slice
+	SliceLights& sliceLights = mSliceLights[slice];
+	sliceLights.x.clear();
+	sliceLights.y.clear();
+	sliceLights.z.clear();
+	sliceLights.radius2.clear();
+	sliceLights.index.clear();
+	for (GLuint i = 0; i < nLights; i++)
+	{
+		const glm::vec4& sphere = mViewSpheres[i];
+		float depth = -sphere.z;
+		if (depth + sphere.w < nearDepth || depth - sphere.w > farDepth)
+			continue;
+
+		sliceLights.x.push_back(sphere.x);
+		sliceLights.y.push_back(sphere.y);
+		sliceLights.z.push_back(sphere.z);
+		sliceLights.radius2.push_back(sphere.w * sphere.w);
+		sliceLights.index.push_back(i);
+	}
+
+	// pad with lights no box can reach
+	GLuint count = (GLuint)sliceLights.index.size();
+	while (sliceLights.index.size() % 4 != 0)
+	{
+		sliceLights.x.push_back(0.0f);
+		sliceLights.y.push_back(0.0f);
+		sliceLights.z.push_back(0.0f);
+		sliceLights.radius2.push_back(-1.0f);
+		sliceLights.index.push_back(0);
+	}
+
+	std::vector<GLuint>& indices = mSliceIndices[slice];
+	indices.clear();
+
+	for (GLuint tile = 0; tile < TILE_COUNT; tile++)
+	{
+		GLuint cluster = slice * TILE_COUNT + tile;
+		GLuint first = (GLuint)indices.size();
+
+		if (count > 0)
+		{
+#ifdef SIMDMATH_SSE
+			// squared distance from each light to the box, four lights at a time
+			__m128 minX = _mm_set1_ps(mMinX[cluster]), maxX = _mm_set1_ps(mMaxX[cluster]);
+			__m128 minY = _mm_set1_ps(mMinY[cluster]), maxY = _mm_set1_ps(mMaxY[cluster]);
+			__m128 minZ = _mm_set1_ps(mMinZ[cluster]), maxZ = _mm_set1_ps(mMaxZ[cluster]);
+			__m128 zero = _mm_setzero_ps();
+
+			for (GLuint i = 0; i < sliceLights.index.size(); i += 4)
+			{
+				__m128 x = _mm_loadu_ps(&sliceLights.x[i]);
+				__m128 y = _mm_loadu_ps(&sliceLights.y[i]);
+				__m128 z = _mm_loadu_ps(&sliceLights.z[i]);
+
+				__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minX, x), _mm_sub_ps(x, maxX)), zero);
+				__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minY, y), _mm_sub_ps(y, maxY)), zero);
+				__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minZ, z), _mm_sub_ps(z, maxZ)), zero);
+				__m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+				int mask = _mm_movemask_ps(_mm_cmple_ps(distance2, _mm_loadu_ps(&sliceLights.radius2[i])));
+				while (mask)
+				{
+					int lane = 0;
+					while (!(mask & (1 << lane)))
+						lane++;
+					indices.push_back(sliceLights.index[i + lane]);
+					mask &= mask - 1;
+				}
+			}
+#else
+			for (GLuint i = 0; i < count; i++)
+			{
+				float dx = std::max(std::max(mMinX[cluster] - sliceLights.x[i], sliceLights.x[i] - mMaxX[cluster]), 0.0f);
+				float dy = std::max(std::max(mMinY[cluster] - sliceLights.y[i], sliceLights.y[i] - mMaxY[cluster]), 0.0f);
+				float dz = std::max(std::max(mMinZ[cluster] - sliceLights.z[i], sliceLights.z[i] - mMaxZ[cluster]), 0.0f);
+				if (dx * dx + dy * dy + dz * dz <= sliceLights.radius2[i])
+					indices.push_back(sliceLights.index[i]);
+			}
+#endif
+		}
+
+		// first is relative to the slice until Build() places the slice's list
+		mClusters[2 * cluster] = first;
+		mClusters[2 * cluster + 1] = (GLuint)indices.size() - first;
+	}
+}
@@ -0,0 +1,88 @@
+///////////////////////////////////////////////////////////////////////////////
+// lightclusters.h
+// ========
+// point lights binned into a view space cluster grid for forward shading
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "jobsystem.h"
+
+// A point light, also the std430 layout of one entry of the LightBlock storage buffer.
+// A radius of 0 reaches every pixel without falloff.
+struct PointLight
+{
+	glm::vec3 position;
+	float radius;
+	glm::vec3 color;
+	float ambientStrength;
+};
+
+class LightClusters
+{
+public:
+	// Screen tiles across, down, and exponential depth slices between the near and far planes
+	static const GLuint GRID_X = 16;
+	static const GLuint GRID_Y = 9;
+	static const GLuint GRID_Z = 24;
+	static const GLuint TILE_COUNT = GRID_X * GRID_Y;
+	static const GLuint CLUSTER_COUNT = TILE_COUNT * GRID_Z;
+
+	static const GLuint LIGHT_BINDING = 3;
+	static const GLuint CLUSTER_BINDING = 4;
+	static const GLuint INDEX_BINDING = 5;
+
+	GLuint lightBuffer = 0;		// PointLight per light
+	GLuint clusterBuffer = 0;	// uvec2 per cluster: first entry in the index buffer and count
+	GLuint indexBuffer = 0;		// Light indices of every cluster, back to back
+	GLuint lightCapacity = 0;
+	GLuint indexCapacity = 0;
+
+	// Statistics of the last Build()
+	GLuint nLights = 0;
+	GLuint nIndices = 0;		// Light to cluster assignments, including any dropped for capacity
+
+public:
+	bool Create(GLuint maxLights, GLuint maxIndices);
+	void Destroy();
+
+	// Assign every light to the clusters its sphere touches, one job per depth slice,
+	// and upload the lights, the grid and the index lists. nearPlane and farPlane must be
+	// the planes of projection.
+	void Build(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+		float nearPlane, float farPlane, JobSystem& jobs);
+
+	// Values the fragment shader needs to find its cluster: view depth of the first
+	// slice boundary and slices per unit of log depth
+	glm::vec2 DepthParameters() const;
+
+private:
+	// View space bounding box of every cluster, structure of arrays, slice by slice
+	std::vector<float> mMinX, mMinY, mMinZ, mMaxX, mMaxY, mMaxZ;
+	glm::mat4 mProjection = glm::mat4(0.0f);
+	float mNear = 0.0f;
+	float mFar = 0.0f;
+
+	// Lights overlapping a slice, structure of arrays padded to a multiple of four
+	struct SliceLights
+	{
+		std::vector<float> x, y, z, radius2;
+		std::vector<GLuint> index;
+	};
+
+	std::vector<glm::vec4> mViewSpheres;
+	std::vector<SliceLights> mSliceLights;
+	std::vector<std::vector<GLuint>> mSliceIndices;	// Index lists of a slice's clusters
+	std::vector<GLuint> mClusters;					// (first, count) pairs
+	std::vector<GLuint> mIndices;
+
+	void UComputeBounds(const glm::mat4& projection, float nearPlane, float farPlane);
+	void UAssignSlice(GLuint slice);
+	float USliceDepth(GLuint slice) const;
+};
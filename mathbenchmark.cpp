@@ -0,0 +1,141 @@
+///////////////////////////////////////////////////////////////////////////////
+// mathbenchmark.cpp
+// ========
+// microbenchmarks of the simdmath kernels against the equivalent glm code
+//
+// Each case runs the glm reference and the kernel on the same inputs,
+// reports the best time of several runs, and checks that both produce the
+// same matrices within float tolerance. Runs without a GL context.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "mathbenchmark.h"
+#include "simdmath.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <glm/gtx/transform.hpp>
+
+namespace
+{
+	// Best wall time of repetitions calls, in milliseconds
+	double BestTime(GLuint repetitions, const std::function<void()>& run)
+	{
+		double best = 1e30;
+		for (GLuint i = 0; i < repetitions; i++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			run();
+			auto end = std::chrono::high_resolution_clock::now();
+			best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+		}
+		return best;
+	}
+
+	float MaxDifference(const std::vector<glm::mat4>& a, const std::vector<glm::mat4>& b)
+	{
+		float difference = 0.0f;
+		for (size_t i = 0; i < a.size(); i++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				for (int r = 0; r < 4; r++)
+					difference = std::max(difference, std::fabs(a[i][c][r] - b[i][c][r]));
+			}
+		}
+		return difference;
+	}
+
+	void Report(const char* name, double glmTime, double simdTime, float difference)
+	{
+		std::cout << "  " << name << ": glm " << glmTime << " ms, simd " << simdTime << " ms, x"
+			<< (simdTime > 0.0 ? glmTime / simdTime : 0.0) << ", max difference " << difference << std::endl;
+	}
+}
+
+///////////////////////////////////////////////////
+//	RunMathBenchmarks(GLuint, GLuint)
+//
+//	count: transforms per case
+//	repetitions: runs per measurement
+///////////////////////////////////////////////////
+void RunMathBenchmarks(GLuint count, GLuint repetitions)
+{
+	std::mt19937 random(330);
+	std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+	std::uniform_real_distribution<float> scale(0.1f, 4.0f);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	std::vector<glm::vec3> translations(count), scales(count);
+	std::vector<glm::quat> rotations(count);
+	std::vector<float> angles(count);
+	std::vector<glm::vec3> axes(count);
+	for (GLuint i = 0; i < count; i++)
+	{
+		translations[i] = glm::vec3(position(random), position(random), position(random));
+		scales[i] = glm::vec3(scale(random), scale(random), scale(random));
+		angles[i] = unit(random) * 3.14159f;
+		axes[i] = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(0.0f, 0.0f, 0.001f));
+		rotations[i] = glm::angleAxis(angles[i], axes[i]);
+	}
+
+	std::cout << "Math benchmarks, " << count << " transforms, best of " << repetitions << " runs" << std::endl;
+
+	// TRS composition
+	std::vector<glm::mat4> reference(count), result(count);
+	double glmTime = BestTime(repetitions, [&]()
+	{
+		for (GLuint i = 0; i < count; i++)
+			reference[i] = glm::translate(translations[i]) * glm::rotate(angles[i], axes[i]) * glm::scale(scales[i]);
+	});
+	double simdTime = BestTime(repetitions, [&]()
+	{
+		for (GLuint i = 0; i < count; i++)
+			result[i] = SimdMath::ComposeTRS(translations[i], rotations[i], scales[i]);
+	});
+	Report("TRS compose", glmTime, simdTime, MaxDifference(reference, result));
+
+	// parents * locals, general and affine
+	std::vector<glm::mat4> parents(reference.rbegin(), reference.rend());
+	std::vector<glm::mat4> locals = reference;
+
+	glmTime = BestTime(repetitions, [&]()
+	{
+		for (GLuint i = 0; i < count; i++)
+			reference[i] = parents[i] * locals[i];
+	});
+	simdTime = BestTime(repetitions, [&]()
+	{
+		SimdMath::MultiplyMat4(parents.data(), locals.data(), result.data(), count);
+	});
+	Report("mat4 x mat4", glmTime, simdTime, MaxDifference(reference, result));
+
+	simdTime = BestTime(repetitions, [&]()
+	{
+		SimdMath::MultiplyAffine(parents.data(), locals.data(), result.data(), count);
+	});
+	Report("affine x affine", glmTime, simdTime, MaxDifference(reference, result));
+
+	// normal matrices
+	std::vector<NormalMatrix> normals(count);
+	glmTime = BestTime(repetitions, [&]()
+	{
+		for (GLuint i = 0; i < count; i++)
+		{
+			glm::mat3 normal = glm::transpose(glm::inverse(glm::mat3(locals[i])));
+			reference[i] = glm::mat4(normal);
+		}
+	});
+	simdTime = BestTime(repetitions, [&]()
+	{
+		SimdMath::ComputeNormalMatrices(locals.data(), normals.data(), count);
+	});
+	for (GLuint i = 0; i < count; i++)
+		result[i] = glm::mat4(normals[i].columns[0], normals[i].columns[1], normals[i].columns[2], glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+	Report("normal matrix", glmTime, simdTime, MaxDifference(reference, result));
+}
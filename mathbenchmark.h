@@ -0,0 +1,13 @@
+///////////////////////////////////////////////////////////////////////////////
+// mathbenchmark.h
+// ========
+// microbenchmarks of the simdmath kernels against the equivalent glm code
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+// Time every kernel over count random transforms, best of repetitions runs, and
+// print the results with the largest difference from glm
+void RunMathBenchmarks(GLuint count, GLuint repetitions);
@@ -8,7 +8,10 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "meshes.h"
+#include "glstate.h"
 
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 namespace
@@ -35,6 +38,7 @@ void Meshes::CreateMeshes()
 	UCreatePyramid4Mesh(gPyramid4Mesh);
 	UCreateSphereMesh(gSphereMesh);
 	UCreateTorusMesh(gTorusMesh);
+	UCreateTessellatedPlaneMesh(gTessellatedPlaneMesh, 64);
 }
 
 ///////////////////////////////////////////////////
@@ -53,6 +57,22 @@ void Meshes::DestroyMeshes()
 	UDestroyMesh(gPrismMesh);
 	UDestroyMesh(gSphereMesh);
 	UDestroyMesh(gTorusMesh);
+	UDestroyMesh(gTessellatedPlaneMesh);
+}
+
+///////////////////////////////////////////////////
+//	GetMeshes()
+//
+//	Every mesh owned by this object, for code that has
+//	to set up per-VAO state on all of them
+///////////////////////////////////////////////////
+std::vector<Meshes::GLMesh*> Meshes::GetMeshes()
+{
+	return {
+		&gBoxMesh, &gConeMesh, &gCylinderMesh, &gTaperedCylinderMesh, &gPlaneMesh,
+		&gPrismMesh, &gSphereMesh, &gPyramid3Mesh, &gPyramid4Mesh, &gTorusMesh,
+		&gTessellatedPlaneMesh
+	};
 }
 
 ///////////////////////////////////////////////////
@@ -92,16 +112,20 @@ void Meshes::UCreatePlaneMesh(GLMesh &mesh)
 	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
 	mesh.nIndices = sizeof(indices) / sizeof(indices[0]);
 
+	// keep a CPU copy for baking and bounds
+	UStoreMeshData(mesh, verts, floatsPerVertex + floatsPerNormal + floatsPerUV);
+	UAppendIndexedTriangles(mesh, indices, mesh.nIndices);
+
 	// Generate the VAO for the mesh
 	glGenVertexArrays(1, &mesh.vao);
-	glBindVertexArray(mesh.vao);	// activate the VAO
+	gGLState.BindVertexArray(mesh.vao);	// activate the VAO
 
 	// Create VBOs for the mesh
 	glGenBuffers(2, mesh.vbos);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
+	gGLState.BindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
 	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends data to the GPU
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]); // Activates the buffer
+	gGLState.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]); // Activates the buffer
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
 	// Strides between vertex coordinates
@@ -163,10 +187,15 @@ void Meshes::UCreatePyramid3Mesh(GLMesh &mesh)
 	// Calculate total defined vertices
 	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerColor + floatsPerUV));
 
+	// keep a CPU copy for baking and bounds
+	UStoreMeshData(mesh, verts, floatsPerVertex + floatsPerColor + floatsPerUV);
+	UAppendTriangles(mesh, GL_TRIANGLE_STRIP, 0, mesh.nVertices);
+
+
 	glGenVertexArrays(1, &mesh.vao);			// Creates 1 VAO
 	glGenBuffers(1, mesh.vbos);					// Creates 1 VBO
-	glBindVertexArray(mesh.vao);				// Activates the VAO
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]);	// Activates the VBO
+	gGLState.BindVertexArray(mesh.vao);				// Activates the VAO
+	gGLState.BindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]);	// Activates the VBO
 	// Sends vertex or coordinate data to the GPU
 	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW);
 
@@ -236,10 +265,15 @@ void Meshes::UCreatePyramid4Mesh(GLMesh &mesh)
 	// Calculate total defined vertices
 	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerColor + floatsPerUV));
 
+	// keep a CPU copy for baking and bounds
+	UStoreMeshData(mesh, verts, floatsPerVertex + floatsPerColor + floatsPerUV);
+	UAppendTriangles(mesh, GL_TRIANGLE_STRIP, 0, mesh.nVertices);
+
+
 	glGenVertexArrays(1, &mesh.vao);			// Creates 1 VAO
 	glGenBuffers(1, mesh.vbos);					// Creates 1 VBO
-	glBindVertexArray(mesh.vao);				// Activates the VAO
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]);	// Activates the VBO
+	gGLState.BindVertexArray(mesh.vao);				// Activates the VAO
+	gGLState.BindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]);	// Activates the VBO
 	// Sends vertex or coordinate data to the GPU
 	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW);
 
@@ -323,12 +357,17 @@ void Meshes::UCreatePrismMesh(GLMesh &mesh)
 
 	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
 
+	// keep a CPU copy for baking and bounds
+	UStoreMeshData(mesh, verts, floatsPerVertex + floatsPerNormal + floatsPerUV);
+	UAppendTriangles(mesh, GL_TRIANGLE_STRIP, 0, mesh.nVertices);
+
+
 	glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-	glBindVertexArray(mesh.vao);
+	gGLState.BindVertexArray(mesh.vao);
 
 	// Create 2 buffers: first one for the vertex data; second one for the indices
 	glGenBuffers(1, mesh.vbos);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
+	gGLState.BindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
 	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
 
 	// Strides between vertex coordinates is 6 (x, y, z, r, g, b, a). A tightly packed stride is 0.
@@ -423,15 +462,19 @@ void Meshes::UCreateBoxMesh(GLMesh &mesh)
 	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
 	mesh.nIndices = sizeof(indices) / sizeof(indices[0]);
 
+	// keep a CPU copy for baking and bounds
+	UStoreMeshData(mesh, verts, floatsPerVertex + floatsPerNormal + floatsPerUV);
+	UAppendIndexedTriangles(mesh, indices, mesh.nIndices);
+
 	glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-	glBindVertexArray(mesh.vao);
+	gGLState.BindVertexArray(mesh.vao);
 
 	// Create 2 buffers: first one for the vertex data; second one for the indices
 	glGenBuffers(2, mesh.vbos);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
+	gGLState.BindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
 	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]); // Activates the buffer
+	gGLState.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]); // Activates the buffer
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
 	// Strides between vertex coordinates is 6 (x, y, z, r, g, b, a). A tightly packed stride is 0.
@@ -621,13 +664,18 @@ void Meshes::UCreateConeMesh(GLMesh &mesh)
 	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
 	mesh.nIndices = 0;
 
+	// keep a CPU copy for baking and bounds
+	UStoreMeshData(mesh, verts, floatsPerVertex + floatsPerNormal + floatsPerUV);
+	UAppendTriangles(mesh, GL_TRIANGLE_FAN, 0, 36);
+	UAppendTriangles(mesh, GL_TRIANGLE_STRIP, 36, 108);
+
 	// Create VAO
 	glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-	glBindVertexArray(mesh.vao);
+	gGLState.BindVertexArray(mesh.vao);
 
 	// Create VBO
 	glGenBuffers(1, mesh.vbos);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
+	gGLState.BindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
 	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
 
 	// Strides between vertex coordinates
@@ -920,13 +968,19 @@ void Meshes::UCreateCylinderMesh(GLMesh &mesh)
 	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
 	mesh.nIndices = 0;
 
+	// keep a CPU copy for baking and bounds
+	UStoreMeshData(mesh, verts, floatsPerVertex + floatsPerNormal + floatsPerUV);
+	UAppendTriangles(mesh, GL_TRIANGLE_FAN, 0, 36);
+	UAppendTriangles(mesh, GL_TRIANGLE_FAN, 36, 36);
+	UAppendTriangles(mesh, GL_TRIANGLE_STRIP, 72, 146);
+
 	// Create VAO
 	glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-	glBindVertexArray(mesh.vao);
+	gGLState.BindVertexArray(mesh.vao);
 
 	// Create VBO
 	glGenBuffers(1, mesh.vbos);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
+	gGLState.BindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
 	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
 
 	// Strides between vertex coordinates
@@ -1193,13 +1247,19 @@ void Meshes::UCreateTaperedCylinderMesh(GLMesh &mesh)
 	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
 	mesh.nIndices = 0;
 
+	// keep a CPU copy for baking and bounds
+	UStoreMeshData(mesh, verts, floatsPerVertex + floatsPerNormal + floatsPerUV);
+	UAppendTriangles(mesh, GL_TRIANGLE_FAN, 0, 36);
+	UAppendTriangles(mesh, GL_TRIANGLE_FAN, 36, 36);
+	UAppendTriangles(mesh, GL_TRIANGLE_STRIP, 72, 146);
+
 	// Create VAO
 	glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-	glBindVertexArray(mesh.vao);
+	gGLState.BindVertexArray(mesh.vao);
 
 	// Create VBO
 	glGenBuffers(1, mesh.vbos);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
+	gGLState.BindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
 	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
 
 	// Strides between vertex coordinates
@@ -1451,13 +1511,17 @@ void Meshes::UCreateTorusMesh(GLMesh &mesh)
 	mesh.nVertices = vertex_list.size();
 	mesh.nIndices = 0;
 
+	// keep a CPU copy for baking and bounds
+	UStoreMeshData(mesh, combined_values.data(), floatsPerVertex + floatsPerNormal + floatsPerUV);
+	UAppendTriangles(mesh, GL_TRIANGLES, 0, mesh.nVertices);
+
 	// Create VAO
 	glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-	glBindVertexArray(mesh.vao);
+	gGLState.BindVertexArray(mesh.vao);
 
 	// Create VBOs
 	glGenBuffers(1, mesh.vbos);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
+	gGLState.BindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
 	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * combined_values.size(), combined_values.data(), GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
 
 	// Strides between vertex coordinates
@@ -2297,16 +2361,20 @@ void Meshes::UCreateSphereMesh(GLMesh &mesh)
 		combined_values.push_back(v);
 	}
 
+	// keep a CPU copy for baking and bounds
+	UStoreMeshData(mesh, combined_values.data(), floatsPerVertex + floatsPerNormal + floatsPerUV);
+	UAppendIndexedTriangles(mesh, indices, mesh.nIndices);
+
 	// Create VAO
 	glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-	glBindVertexArray(mesh.vao);
+	gGLState.BindVertexArray(mesh.vao);
 
 	// Create VBOs
 	glGenBuffers(2, mesh.vbos);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the vertex buffer
+	gGLState.BindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the vertex buffer
 	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * combined_values.size(), combined_values.data(), GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]); // Activates the index buffer
+	gGLState.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]); // Activates the index buffer
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
 	// Strides between vertex coordinates
@@ -2325,6 +2393,231 @@ void Meshes::UCreateSphereMesh(GLMesh &mesh)
 
 void Meshes::UDestroyMesh(GLMesh &mesh)
 {
-	glDeleteVertexArrays(1, &mesh.vao);
-	glDeleteBuffers(2, mesh.vbos);
-}
\ No newline at end of file
+	gGLState.DeleteVertexArrays(1, &mesh.vao);
+	gGLState.DeleteBuffers(2, mesh.vbos);
+}
+
+///////////////////////////////////////////////////
+//	UCreateTessellatedPlaneMesh(GLMesh&, GLuint)
+//
+//	mesh: reference to mesh structure for storing data
+//	divisions: number of quads along each side
+//
+//	Create a subdivided plane mesh with the same extents
+//	and texture coordinates as the plane mesh, so that
+//	per-vertex data such as baked ambient occlusion has
+//	enough resolution across large surfaces
+//
+//  Correct triangle drawing command:
+//
+//	glDrawElements(GL_TRIANGLES, meshes.gTessellatedPlaneMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+///////////////////////////////////////////////////
+void Meshes::UCreateTessellatedPlaneMesh(GLMesh &mesh, GLuint divisions)
+{
+	std::vector<GLfloat> verts;
+	std::vector<GLuint> indices;
+
+	// generate the grid vertices, row by row from the front edge
+	for (GLuint row = 0; row <= divisions; row++)
+	{
+		float v = float(row) / float(divisions);
+		for (GLuint col = 0; col <= divisions; col++)
+		{
+			float u = float(col) / float(divisions);
+
+			verts.push_back(-1.0f + 2.0f * u);	// position
+			verts.push_back(0.0f);
+			verts.push_back(1.0f - 2.0f * v);
+			verts.push_back(0.0f);				// normal
+			verts.push_back(1.0f);
+			verts.push_back(0.0f);
+			verts.push_back(u);					// texture coords
+			verts.push_back(v);
+		}
+	}
+
+	// connect the grid into two triangles per quad
+	for (GLuint row = 0; row < divisions; row++)
+	{
+		for (GLuint col = 0; col < divisions; col++)
+		{
+			GLuint i0 = row * (divisions + 1) + col;
+			GLuint i1 = i0 + 1;
+			GLuint i2 = i1 + (divisions + 1);
+			GLuint i3 = i0 + (divisions + 1);
+
+			indices.push_back(i0);
+			indices.push_back(i1);
+			indices.push_back(i2);
+			indices.push_back(i0);
+			indices.push_back(i3);
+			indices.push_back(i2);
+		}
+	}
+
+	// total float values per each type
+	const GLuint floatsPerVertex = 3;
+	const GLuint floatsPerNormal = 3;
+	const GLuint floatsPerUV = 2;
+
+	// store vertex and index count
+	mesh.nVertices = verts.size() / (floatsPerVertex + floatsPerNormal + floatsPerUV);
+	mesh.nIndices = indices.size();
+
+	// keep a CPU copy for baking and bounds
+	UStoreMeshData(mesh, verts.data(), floatsPerVertex + floatsPerNormal + floatsPerUV);
+	UAppendIndexedTriangles(mesh, indices.data(), mesh.nIndices);
+
+	// Create VAO
+	glGenVertexArrays(1, &mesh.vao);
+	gGLState.BindVertexArray(mesh.vao);
+
+	// Create VBOs
+	glGenBuffers(2, mesh.vbos);
+	gGLState.BindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the vertex buffer
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * verts.size(), verts.data(), GL_STATIC_DRAW);
+
+	gGLState.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]); // Activates the index buffer
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(), indices.data(), GL_STATIC_DRAW);
+
+	// Strides between vertex coordinates
+	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
+
+	// Create Vertex Attribute Pointers
+	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
+	glEnableVertexAttribArray(0);
+
+	glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
+	glEnableVertexAttribArray(1);
+
+	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
+	glEnableVertexAttribArray(2);
+}
+
+///////////////////////////////////////////////////
+//	UStoreMeshData(GLMesh&, const GLfloat*, GLuint)
+//
+//	mesh: mesh whose nVertices has already been set
+//	verts: interleaved vertex data, position then normal,
+//	texture coordinates last
+//	floatsPerVertex: total floats per interleaved vertex
+//
+//	Keep a CPU copy of the positions and normals so the
+//	mesh can be ray cast after upload, and compute its
+//	bounding box and sphere
+///////////////////////////////////////////////////
+void Meshes::UStoreMeshData(GLMesh &mesh, const GLfloat* verts, GLuint floatsPerVertex)
+{
+	mesh.positions.resize(mesh.nVertices);
+	mesh.normals.resize(mesh.nVertices);
+	mesh.texCoords.resize(mesh.nVertices);
+	mesh.triangles.clear();
+
+	for (GLuint i = 0; i < mesh.nVertices; i++)
+	{
+		const GLfloat* vertex = verts + i * floatsPerVertex;
+		mesh.positions[i] = glm::vec3(vertex[0], vertex[1], vertex[2]);
+		mesh.normals[i] = glm::vec3(vertex[3], vertex[4], vertex[5]);
+		mesh.texCoords[i] = glm::vec2(vertex[floatsPerVertex - 2], vertex[floatsPerVertex - 1]);
+	}
+
+	mesh.boundsMin = mesh.boundsMax = mesh.nVertices > 0 ? mesh.positions[0] : glm::vec3(0.0f);
+	for (const glm::vec3& position : mesh.positions)
+	{
+		mesh.boundsMin = glm::min(mesh.boundsMin, position);
+		mesh.boundsMax = glm::max(mesh.boundsMax, position);
+	}
+
+	// sphere around the box center, as tight as the vertices allow
+	glm::vec3 center = (mesh.boundsMin + mesh.boundsMax) * 0.5f;
+	float radius2 = 0.0f;
+	for (const glm::vec3& position : mesh.positions)
+		radius2 = std::max(radius2, glm::dot(position - center, position - center));
+	mesh.boundingSphere = glm::vec4(center, std::sqrt(radius2));
+}
+
+///////////////////////////////////////////////////
+//	UAppendTriangles(GLMesh&, GLenum, GLuint, GLuint)
+//
+//	mesh: mesh receiving the triangles
+//	mode: GL_TRIANGLES, GL_TRIANGLE_STRIP or GL_TRIANGLE_FAN
+//	first, count: vertex range of the drawing command
+//
+//	Convert a glDrawArrays() command into triangle list
+//	indices of the mesh's CPU copy
+///////////////////////////////////////////////////
+void Meshes::UAppendTriangles(GLMesh &mesh, GLenum mode, GLuint first, GLuint count)
+{
+	AppendRangeTriangles(mesh, { mode, (GLint)first, (GLsizei)count }, mesh.triangles);
+}
+
+///////////////////////////////////////////////////
+//	AppendRangeTriangles(const GLMesh&, const DrawRange&, std::vector<GLuint>&)
+//
+//	mesh: mesh the drawing command is issued on
+//	range: the drawing command; a vertex range for
+//	glDrawArrays() meshes, an index range otherwise
+//	triangles: receives the triangle list indices
+//
+//	Assemble the command's primitives the same way
+//	OpenGL does, so a triangle list drawn with
+//	glDrawElements() covers the same surface
+///////////////////////////////////////////////////
+void Meshes::AppendRangeTriangles(const GLMesh &mesh, const DrawRange &range, std::vector<GLuint> &triangles)
+{
+	GLuint first = range.first;
+	GLuint count = range.count;
+
+	if (mesh.nIndices > 0)
+	{
+		// indexed meshes are triangle lists already, kept in mesh.triangles
+		if (first + count > mesh.triangles.size())
+			count = mesh.triangles.size() > first ? (GLuint)mesh.triangles.size() - first : 0;
+		count -= count % 3;
+		triangles.insert(triangles.end(), mesh.triangles.begin() + first, mesh.triangles.begin() + first + count);
+		return;
+	}
+
+	if (first + count > mesh.nVertices)
+		count = mesh.nVertices > first ? mesh.nVertices - first : 0;
+
+	for (GLuint i = 2; i < count; i++)
+	{
+		if (range.mode == GL_TRIANGLES && i % 3 != 2)
+			continue;
+
+		GLuint a, b, c;
+		if (range.mode == GL_TRIANGLES)
+		{
+			a = first + i - 2; b = first + i - 1; c = first + i;
+		}
+		else if (range.mode == GL_TRIANGLE_FAN)
+		{
+			a = first; b = first + i - 1; c = first + i;
+		}
+		else
+		{
+			// strips alternate winding every other triangle
+			a = first + i - 2; b = first + i - 1; c = first + i;
+			if (i % 2 == 1)
+				std::swap(a, b);
+		}
+
+		triangles.push_back(a);
+		triangles.push_back(b);
+		triangles.push_back(c);
+	}
+}
+
+///////////////////////////////////////////////////
+//	UAppendIndexedTriangles(GLMesh&, const GLuint*, GLuint)
+//
+//	mesh: mesh receiving the triangles
+//	indices, nIndices: GL_TRIANGLES index data
+//
+//	Copy a glDrawElements() triangle list
+///////////////////////////////////////////////////
+void Meshes::UAppendIndexedTriangles(GLMesh &mesh, const GLuint* indices, GLuint nIndices)
+{
+	mesh.triangles.insert(mesh.triangles.end(), indices, indices + nIndices - nIndices % 3);
+}
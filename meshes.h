@@ -13,8 +13,11 @@
 
 #include <glm/glm.hpp>
 
+#include <vector>
+
 class Meshes
 {
+public:
 	// Stores the GL data relative to a given mesh
 	struct GLMesh
 	{
@@ -22,6 +25,23 @@ class Meshes
 		GLuint vbos[2];     // Handles for the vertex buffer objects
 		GLuint nVertices;	// Number of vertices for the mesh
 		GLuint nIndices;    // Number of indices for the mesh
+
+		std::vector<glm::vec3> positions;	// CPU copy of the vertex positions
+		std::vector<glm::vec3> normals;		// CPU copy of the vertex normals
+		std::vector<glm::vec2> texCoords;	// CPU copy of the texture coordinates
+		std::vector<GLuint> triangles;		// Triangle list covering the mesh's drawing commands
+
+		glm::vec3 boundsMin;				// Object space bounding box
+		glm::vec3 boundsMax;
+		glm::vec4 boundingSphere;			// Object space center in xyz, radius in w
+	};
+
+	// One drawing command over a range of a mesh's vertices (or indices, for indexed meshes)
+	struct DrawRange
+	{
+		GLenum mode;
+		GLint first;
+		GLsizei count;
 	};
 
 public:
@@ -35,10 +55,16 @@ public:
 	GLMesh gPyramid3Mesh;
 	GLMesh gPyramid4Mesh;
 	GLMesh gTorusMesh;
+	GLMesh gTessellatedPlaneMesh;
 
 public:
 	void CreateMeshes();
 	void DestroyMeshes();
+	std::vector<GLMesh*> GetMeshes();
+
+	// Append the triangle list drawn by one drawing command of a mesh, as indices
+	// into the mesh's vertices
+	static void AppendRangeTriangles(const GLMesh &mesh, const DrawRange &range, std::vector<GLuint> &triangles);
 
 private:
 	void UCreatePlaneMesh(GLMesh &mesh);
@@ -51,8 +77,13 @@ private:
 	void UCreatePyramid3Mesh(GLMesh &mesh);
 	void UCreatePyramid4Mesh(GLMesh &mesh);
 	void UCreateSphereMesh(GLMesh &mesh);
+	void UCreateTessellatedPlaneMesh(GLMesh &mesh, GLuint divisions);
+
+	void UStoreMeshData(GLMesh &mesh, const GLfloat* verts, GLuint floatsPerVertex);
+	void UAppendTriangles(GLMesh &mesh, GLenum mode, GLuint first, GLuint count);
+	void UAppendIndexedTriangles(GLMesh &mesh, const GLuint* indices, GLuint nIndices);
 
 	void UDestroyMesh(GLMesh &mesh);
 
 	void CalculateTriangleNormal(glm::vec3 px, glm::vec3 py, glm::vec3 pz);
-};
\ No newline at end of file
+};
@@ -0,0 +1,167 @@
+///////////////////////////////////////////////////////////////////////////////
+// meshpool.cpp
+// ========
+// shared vertex and index buffers holding every mesh, for multi-draw submission
+//
+// Multi-draw indirect commands can only vary offsets into the buffers of the
+// bound VAO, so every mesh is copied, from its CPU copy, into one vertex
+// buffer. Strips and fans are converted to triangle lists on registration,
+// which lets every object be drawn with GL_TRIANGLES and GL_UNSIGNED_INT.
+// Vertices that belong to no mesh, such as static geometry already moved
+// into world space, can be appended after the meshes'.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "meshpool.h"
+#include "glstate.h"
+
+#include <algorithm>
+
+///////////////////////////////////////////////////
+//	Create(const std::vector<Meshes::GLMesh*>&)
+//
+//	meshes: meshes whose CPU copy is pooled; they can be
+//	registered with Add() afterwards
+///////////////////////////////////////////////////
+bool MeshPool::Create(const std::vector<Meshes::GLMesh*>& meshes)
+{
+	std::vector<GLfloat>& verts = mVertices;
+	verts.clear();
+	GLint nVertices = 0;
+	for (const Meshes::GLMesh* mesh : meshes)
+	{
+		mMeshes.push_back(mesh);
+		mBaseVertices.push_back(nVertices);
+
+		for (GLuint i = 0; i < mesh->positions.size(); i++)
+		{
+			const glm::vec3& position = mesh->positions[i];
+			const glm::vec3& normal = mesh->normals[i];
+			const glm::vec2& uv = mesh->texCoords[i];
+			verts.insert(verts.end(), { position.x, position.y, position.z, normal.x, normal.y, normal.z, uv.x, uv.y });
+		}
+		nVertices += (GLint)mesh->positions.size();
+	}
+
+	glGenVertexArrays(1, &vao);
+	gGLState.BindVertexArray(vao);
+
+	glGenBuffers(1, &vertexBuffer);
+	gGLState.BindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * verts.size(), verts.data(), GL_STATIC_DRAW);
+	gGLState.BindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glGenBuffers(1, &indexBuffer);
+	gGLState.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);	// recorded in the VAO
+
+	glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, 0);
+	glVertexAttribFormat(1, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 3);
+	glVertexAttribFormat(2, 2, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 6);
+	for (GLuint attribute = 0; attribute < 3; attribute++)
+	{
+		glVertexAttribBinding(attribute, 0);
+		glEnableVertexAttribArray(attribute);
+	}
+	glBindVertexBuffer(0, vertexBuffer, 0, sizeof(GLfloat) * FLOATS_PER_VERTEX);
+
+	gGLState.BindVertexArray(0);
+
+	return vao && vertexBuffer && indexBuffer;
+}
+
+void MeshPool::Destroy()
+{
+	gGLState.DeleteVertexArrays(1, &vao);
+	gGLState.DeleteBuffers(1, &vertexBuffer);
+	gGLState.DeleteBuffers(1, &indexBuffer);
+	vao = vertexBuffer = indexBuffer = 0;
+
+	mVertices.clear();
+	mVerticesChanged = false;
+	mMeshes.clear();
+	mBaseVertices.clear();
+	mEntries.clear();
+	mIndices.clear();
+}
+
+///////////////////////////////////////////////////
+//	Add(const Meshes::GLMesh&, const Meshes::DrawRange*, int)
+//
+//	mesh: a mesh passed to Create()
+//	ranges, nRanges: drawing commands issued on the mesh
+//
+//	Returns an empty range for meshes outside the pool
+///////////////////////////////////////////////////
+MeshPool::Range MeshPool::Add(const Meshes::GLMesh& mesh, const Meshes::DrawRange* ranges, int nRanges)
+{
+	for (const Entry& entry : mEntries)
+	{
+		if (entry.mesh == &mesh && USameRanges(entry, ranges, nRanges))
+			return entry.range;
+	}
+
+	auto found = std::find(mMeshes.begin(), mMeshes.end(), &mesh);
+	if (found == mMeshes.end())
+		return { 0, 0, 0 };
+
+	Entry entry;
+	entry.mesh = &mesh;
+	entry.ranges.assign(ranges, ranges + nRanges);
+	entry.range.firstIndex = (GLuint)mIndices.size();
+	entry.range.baseVertex = mBaseVertices[found - mMeshes.begin()];
+
+	for (int i = 0; i < nRanges; i++)
+		Meshes::AppendRangeTriangles(mesh, ranges[i], mIndices);
+
+	entry.range.nIndices = (GLuint)mIndices.size() - entry.range.firstIndex;
+	mEntries.push_back(entry);
+	return entry.range;
+}
+
+GLint MeshPool::AddVertices(const std::vector<GLfloat>& vertices)
+{
+	GLint first = (GLint)(mVertices.size() / FLOATS_PER_VERTEX);
+	mVertices.insert(mVertices.end(), vertices.begin(), vertices.end());
+	mVerticesChanged = true;
+	return first;
+}
+
+MeshPool::Range MeshPool::AddTriangles(const std::vector<GLuint>& indices, GLint baseVertex)
+{
+	Range range;
+	range.firstIndex = (GLuint)mIndices.size();
+	range.nIndices = (GLuint)indices.size();
+	range.baseVertex = baseVertex;
+	mIndices.insert(mIndices.end(), indices.begin(), indices.end());
+	return range;
+}
+
+void MeshPool::Upload()
+{
+	if (mVerticesChanged)
+	{
+		gGLState.BindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * mVertices.size(), mVertices.data(), GL_STATIC_DRAW);
+		gGLState.BindBuffer(GL_ARRAY_BUFFER, 0);
+		mVerticesChanged = false;
+	}
+
+	// the element binding is VAO state, so go through the pool's VAO
+	gGLState.BindVertexArray(vao);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * mIndices.size(), mIndices.data(), GL_STATIC_DRAW);
+	gGLState.BindVertexArray(0);
+}
+
+bool MeshPool::USameRanges(const Entry& entry, const Meshes::DrawRange* ranges, int nRanges)
+{
+	if ((int)entry.ranges.size() != nRanges)
+		return false;
+
+	for (int i = 0; i < nRanges; i++)
+	{
+		const Meshes::DrawRange& a = entry.ranges[i];
+		const Meshes::DrawRange& b = ranges[i];
+		if (a.mode != b.mode || a.first != b.first || a.count != b.count)
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,69 @@
+///////////////////////////////////////////////////////////////////////////////
+// meshpool.h
+// ========
+// shared vertex and index buffers holding every mesh, for multi-draw submission
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <vector>
+
+#include "meshes.h"
+
+class MeshPool
+{
+public:
+	// Triangles of one registered set of drawing commands
+	struct Range
+	{
+		GLuint firstIndex;	// First index in the pool's index buffer
+		GLuint nIndices;	// Number of indices, a multiple of three
+		GLint baseVertex;	// Pool position of the mesh's first vertex, added to every index
+	};
+
+	// Position, normal and texture coordinates
+	static const GLuint FLOATS_PER_VERTEX = 8;
+
+	GLuint vao = 0;
+	GLuint vertexBuffer = 0;
+	GLuint indexBuffer = 0;
+
+public:
+	// Copy the vertices of every mesh into one buffer, interleaved as position,
+	// normal and texture coordinates at attribute locations 0, 1 and 2
+	bool Create(const std::vector<Meshes::GLMesh*>& meshes);
+	void Destroy();
+
+	// Register the triangles drawn by a set of drawing commands on a pooled mesh.
+	// Identical sets share one range.
+	Range Add(const Meshes::GLMesh& mesh, const Meshes::DrawRange* ranges, int nRanges);
+
+	// Append vertices, interleaved as the pooled meshes', e.g. pre-transformed copies.
+	// Returns the pool position of the first.
+	GLint AddVertices(const std::vector<GLfloat>& vertices);
+
+	// Register a triangle list whose indices count from baseVertex
+	Range AddTriangles(const std::vector<GLuint>& indices, GLint baseVertex);
+
+	// Send the indices registered so far, and any vertices appended, to the GPU
+	void Upload();
+
+private:
+	struct Entry
+	{
+		const Meshes::GLMesh* mesh;
+		std::vector<Meshes::DrawRange> ranges;
+		Range range;
+	};
+
+	std::vector<GLfloat> mVertices;		// CPU copy of the vertex buffer
+	bool mVerticesChanged = false;
+	std::vector<const Meshes::GLMesh*> mMeshes;
+	std::vector<GLint> mBaseVertices;
+	std::vector<Entry> mEntries;
+	std::vector<GLuint> mIndices;
+
+	static bool USameRanges(const Entry& entry, const Meshes::DrawRange* ranges, int nRanges);
+};
@@ -0,0 +1,168 @@
+///////////////////////////////////////////////////////////////////////////////
+// multidrawbatcher.cpp
+// ========
+// submits the scene from a mesh pool with glMultiDrawElementsIndirect()
+//
+// Every object becomes a DrawElementsIndirectCommand whose base instance
+// is the object's entry in the object buffer, so the vertex shader reads
+// its data through the draw id attribute exactly as for direct draws. The
+// number of GL calls depends on the number of textures, not of objects.
+// Objects of a static batch share one world space object entry and lie
+// next to each other in the index buffer, so the visible ones of a batch
+// collapse into as few commands as there are gaps between them.
+// Objects and commands are both written into the frame's ring section.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "multidrawbatcher.h"
+#include "glstate.h"
+
+#include <algorithm>
+
+///////////////////////////////////////////////////
+//	Create(GLuint)
+//
+//	maxCommands: capacity of the indirect buffer, and
+//	the most objects one Flush() can draw
+///////////////////////////////////////////////////
+bool MultiDrawBatcher::Create(GLuint maxCommands)
+{
+	commandCapacity = maxCommands;
+	return maxCommands > 0;
+}
+
+void MultiDrawBatcher::Destroy()
+{
+	commandCapacity = 0;
+	mObjectRange = StreamRange();
+	mCommandRange = StreamRange();
+}
+
+void MultiDrawBatcher::Begin()
+{
+	mItems.clear();
+}
+
+void MultiDrawBatcher::Add(const IndirectItem& item)
+{
+	mItems.push_back(item);
+}
+
+///////////////////////////////////////////////////
+//	Flush(SceneBuffers&, const MeshPool&, GLuint)
+//
+//	buffers: receives the object data of every item
+//	pool: holds the geometry of every item
+//	programId: program drawing the items
+///////////////////////////////////////////////////
+void MultiDrawBatcher::Flush(SceneBuffers& buffers, const MeshPool& pool, GLuint programId)
+{
+	nItems = (GLuint)mItems.size();
+	nCommands = 0;
+	nDrawCalls = 0;
+
+	if (mItems.empty())
+		return;
+
+	// textures stay bound for a whole multi-draw, so they come first in the order
+	mOrder.resize(mItems.size());
+	for (GLuint i = 0; i < mOrder.size(); i++)
+		mOrder[i] = i;
+	std::stable_sort(mOrder.begin(), mOrder.end(), [this](GLuint a, GLuint b)
+	{
+		return UItemLess(mItems[a], mItems[b]);
+	});
+
+	// a full ring section draws fewer objects rather than overwrite data in flight
+	GLuint count = std::min(std::min<GLuint>(nItems, buffers.objectCapacity), commandCapacity);
+	count = std::min(count, buffers.StreamRoom(sizeof(ObjectData) + sizeof(DrawElementsIndirectCommand), 2));
+	if (count == 0)
+		return;
+	mObjects.resize(count);
+	mCommands.clear();
+	for (GLuint i = 0; i < count; i++)
+	{
+		const IndirectItem& item = mItems[mOrder[i]];
+		mObjects[i] = item.object;
+
+		// consecutive objects on the same range become instances of one command
+		if (i > 0)
+		{
+			const IndirectItem& previous = mItems[mOrder[i - 1]];
+			if (previous.textureId == item.textureId && USameRange(previous.range, item.range))
+			{
+				mCommands.back().instanceCount++;
+				continue;
+			}
+
+			// the next triangles of the same static batch extend the command
+			DrawElementsIndirectCommand& last = mCommands.back();
+			if (item.batch != 0 && previous.batch == item.batch && last.instanceCount == 1 &&
+				last.firstIndex + last.count == item.range.firstIndex && last.baseVertex == item.range.baseVertex)
+			{
+				last.count += item.range.nIndices;
+				continue;
+			}
+		}
+		mCommands.push_back({ item.range.nIndices, 1, item.range.firstIndex, item.range.baseVertex, i });
+	}
+	nCommands = (GLuint)mCommands.size();
+
+	mObjectRange = buffers.UpdateObjects(mObjects.data(), count);
+	mCommandRange = buffers.Stream(mCommands.data(), sizeof(DrawElementsIndirectCommand) * mCommands.size());
+
+	gGLState.BindBuffer(GL_DRAW_INDIRECT_BUFFER, mCommandRange.buffer);
+	UDraw(pool, programId);
+}
+
+void MultiDrawBatcher::Redraw(const MeshPool& pool, GLuint programId)
+{
+	nDrawCalls = 0;
+	if (nCommands == 0)
+		return;
+
+	SceneBuffers::BindObjects(mObjectRange);
+	gGLState.BindBuffer(GL_DRAW_INDIRECT_BUFFER, mCommandRange.buffer);
+	UDraw(pool, programId);
+}
+
+// Issue the commands in mCommands from the bound indirect buffer
+void MultiDrawBatcher::UDraw(const MeshPool& pool, GLuint programId)
+{
+	gGLState.UseProgram(programId);
+	gGLState.BindVertexArray(pool.vao);
+	gGLState.ActiveTexture(GL_TEXTURE0);
+
+	// one multi-draw per run of commands sharing a texture
+	GLuint first = 0;
+	while (first < nCommands)
+	{
+		GLuint textureId = mItems[mOrder[mCommands[first].baseInstance]].textureId;
+
+		GLuint end = first + 1;
+		while (end < nCommands && mItems[mOrder[mCommands[end].baseInstance]].textureId == textureId)
+			end++;
+
+		gGLState.BindTexture(GL_TEXTURE_2D_ARRAY, textureId);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(mCommandRange.offset + sizeof(DrawElementsIndirectCommand) * first), end - first, 0);
+		nDrawCalls++;
+
+		first = end;
+	}
+
+	gGLState.BindVertexArray(0);
+	gGLState.BindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+bool MultiDrawBatcher::UItemLess(const IndirectItem& a, const IndirectItem& b)
+{
+	if (a.textureId != b.textureId)
+		return a.textureId < b.textureId;
+	if (a.range.firstIndex != b.range.firstIndex)
+		return a.range.firstIndex < b.range.firstIndex;
+	return a.range.baseVertex < b.range.baseVertex;
+}
+
+bool MultiDrawBatcher::USameRange(const MeshPool::Range& a, const MeshPool::Range& b)
+{
+	return a.firstIndex == b.firstIndex && a.nIndices == b.nIndices && a.baseVertex == b.baseVertex;
+}
@@ -0,0 +1,75 @@
+///////////////////////////////////////////////////////////////////////////////
+// multidrawbatcher.h
+// ========
+// submits the scene from a mesh pool with glMultiDrawElementsIndirect()
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <vector>
+
+#include "meshpool.h"
+#include "scenebuffers.h"
+
+// Layout of one command of the GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;	// Object buffer entry of the first instance, read back as drawId
+};
+
+// One pooled object submitted for drawing this frame
+struct IndirectItem
+{
+	MeshPool::Range range;
+	GLuint textureId;		// GL_TEXTURE_2D_ARRAY holding the item's texture layer
+	ObjectData object;		// Per-object data written to the object buffer
+	GLuint batch = 0;		// Static batch the range belongs to, 0 for none
+};
+
+class MultiDrawBatcher
+{
+public:
+	// Statistics of the last Flush()
+	GLuint nItems = 0;
+	GLuint nCommands = 0;
+	GLuint nDrawCalls = 0;
+
+	GLuint commandCapacity = 0;
+
+public:
+	// Commands are streamed through the scene buffers' ring, so only the limit is set here
+	bool Create(GLuint maxCommands);
+	void Destroy();
+
+	void Begin();
+	void Add(const IndirectItem& item);
+
+	// Write one indirect command per run of identical ranges, instanced over the run,
+	// or per run of adjacent ranges of one static batch, and submit each texture's
+	// commands with a single multi-draw call
+	void Flush(SceneBuffers& buffers, const MeshPool& pool, GLuint programId);
+
+	// Submit the commands of the last Flush() again with another program, reusing the
+	// streamed objects and commands as they are, e.g. to shade after a depth prepass.
+	// Only valid in the frame of that Flush().
+	void Redraw(const MeshPool& pool, GLuint programId);
+
+private:
+	std::vector<IndirectItem> mItems;
+	std::vector<GLuint> mOrder;
+	std::vector<ObjectData> mObjects;
+	std::vector<DrawElementsIndirectCommand> mCommands;
+	StreamRange mObjectRange;
+	StreamRange mCommandRange;
+
+	void UDraw(const MeshPool& pool, GLuint programId);
+
+	static bool UItemLess(const IndirectItem& a, const IndirectItem& b);
+	static bool USameRange(const MeshPool::Range& a, const MeshPool::Range& b);
+};
@@ -0,0 +1,262 @@
+///////////////////////////////////////////////////////////////////////////////
+// occlusionbuffer.cpp
+// ========
+// low resolution CPU depth buffer of occluder proxies, for occlusion culling
+//
+// A few low-poly proxies of the largest objects are rasterized into a
+// small depth buffer, eight pixels per AVX instruction and one screen tile
+// per job, and every other object's bounding box is tested against it
+// before submission. Everything happens on the CPU in the same frame, so
+// there is no GPU readback and no frame of latency, and it costs the same
+// on a software GL driver as on real hardware. Each 8x8 block also keeps
+// its farthest depth, which answers most box tests without touching
+// individual pixels.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "occlusionbuffer.h"
+#include "simdmath.h"
+
+#include <algorithm>
+
+#ifdef SIMDMATH_AVX
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	// Clip space w below which a point counts as behind the eye
+	const float NEAR_W = 1.0e-4f;
+}
+
+void OcclusionBuffer::Begin(const glm::mat4& viewProjection)
+{
+	mViewProjection = viewProjection;
+	mDepth.resize(WIDTH * HEIGHT);
+	mBlockMax.resize((WIDTH / BLOCK_SIZE) * (HEIGHT / BLOCK_SIZE));
+	mBins.resize(TILES_X * TILES_Y);
+	for (std::vector<GLuint>& bin : mBins)
+		bin.clear();
+	mTriangles.clear();
+	nTriangles = 0;
+}
+
+void OcclusionBuffer::AddOccluder(const OccluderMesh& mesh, const glm::mat4& model)
+{
+	glm::mat4 transform = mViewProjection * model;
+
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		ScreenTriangle triangle;
+		bool behind = false;
+		for (int corner = 0; corner < 3; corner++)
+		{
+			glm::vec4 clip = transform * glm::vec4(mesh.vertices[mesh.indices[i + corner]], 1.0f);
+			if (clip.w < NEAR_W)
+			{
+				behind = true;
+				break;
+			}
+			float inverseW = 1.0f / clip.w;
+			triangle.x[corner] = (clip.x * inverseW * 0.5f + 0.5f) * WIDTH;
+			triangle.y[corner] = (clip.y * inverseW * 0.5f + 0.5f) * HEIGHT;
+			triangle.z[corner] = clip.z * inverseW * 0.5f + 0.5f;
+		}
+		if (behind)
+			continue;
+
+		float minX = std::min(std::min(triangle.x[0], triangle.x[1]), triangle.x[2]);
+		float maxX = std::max(std::max(triangle.x[0], triangle.x[1]), triangle.x[2]);
+		float minY = std::min(std::min(triangle.y[0], triangle.y[1]), triangle.y[2]);
+		float maxY = std::max(std::max(triangle.y[0], triangle.y[1]), triangle.y[2]);
+		if (maxX < 0.0f || maxY < 0.0f || minX >= WIDTH || minY >= HEIGHT)
+			continue;
+
+		GLuint index = (GLuint)mTriangles.size();
+		mTriangles.push_back(triangle);
+		nTriangles++;
+
+		GLuint tileX0 = (GLuint)std::max(minX, 0.0f) / TILE_WIDTH;
+		GLuint tileX1 = std::min((GLuint)std::max(maxX, 0.0f) / TILE_WIDTH, TILES_X - 1);
+		GLuint tileY0 = (GLuint)std::max(minY, 0.0f) / TILE_HEIGHT;
+		GLuint tileY1 = std::min((GLuint)std::max(maxY, 0.0f) / TILE_HEIGHT, TILES_Y - 1);
+		for (GLuint tileY = tileY0; tileY <= tileY1; tileY++)
+		{
+			for (GLuint tileX = tileX0; tileX <= tileX1; tileX++)
+				mBins[tileY * TILES_X + tileX].push_back(index);
+		}
+	}
+}
+
+void OcclusionBuffer::Rasterize(JobSystem& jobs)
+{
+	jobs.ParallelFor(TILES_X * TILES_Y, [this](GLuint tile) { URasterizeTile(tile); });
+}
+
+// Clear a tile, draw its triangles and summarize its blocks; touches nothing outside the tile
+void OcclusionBuffer::URasterizeTile(GLuint tile)
+{
+	GLuint tileX0 = (tile % TILES_X) * TILE_WIDTH;
+	GLuint tileY0 = (tile / TILES_X) * TILE_HEIGHT;
+
+	for (GLuint y = tileY0; y < tileY0 + TILE_HEIGHT; y++)
+		std::fill_n(&mDepth[y * WIDTH + tileX0], TILE_WIDTH, 1.0f);
+
+	for (GLuint index : mBins[tile])
+		URasterizeTriangle(mTriangles[index], tileX0, tileY0);
+
+	const GLuint blocksPerRow = WIDTH / BLOCK_SIZE;
+	for (GLuint blockY = tileY0; blockY < tileY0 + TILE_HEIGHT; blockY += BLOCK_SIZE)
+	{
+		for (GLuint blockX = tileX0; blockX < tileX0 + TILE_WIDTH; blockX += BLOCK_SIZE)
+		{
+			float farthest = 0.0f;
+			for (GLuint y = blockY; y < blockY + BLOCK_SIZE; y++)
+			{
+				const float* row = &mDepth[y * WIDTH + blockX];
+				for (GLuint x = 0; x < BLOCK_SIZE; x++)
+					farthest = std::max(farthest, row[x]);
+			}
+			mBlockMax[(blockY / BLOCK_SIZE) * blocksPerRow + blockX / BLOCK_SIZE] = farthest;
+		}
+	}
+}
+
+///////////////////////////////////////////////////
+//	URasterizeTriangle(const ScreenTriangle&, GLuint, GLuint)
+//
+//	Edge functions and the depth plane are evaluated
+//	at pixel centers, eight pixels of a row at a time.
+//	Pixels keep the nearest depth. Either winding is
+//	drawn, since proxies are closed and small.
+///////////////////////////////////////////////////
+void OcclusionBuffer::URasterizeTriangle(const ScreenTriangle& triangle, GLuint tileX0, GLuint tileY0)
+{
+	float x0 = triangle.x[0], y0 = triangle.y[0];
+	float x1 = triangle.x[1], y1 = triangle.y[1];
+	float x2 = triangle.x[2], y2 = triangle.y[2];
+
+	float area = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+	if (area == 0.0f)
+		return;
+	float sign = area > 0.0f ? 1.0f : -1.0f;
+
+	// edge i is positive on the inner side: E(x, y) = a * x + b * y + c
+	float a[3] = { sign * (y0 - y1), sign * (y1 - y2), sign * (y2 - y0) };
+	float b[3] = { sign * (x1 - x0), sign * (x2 - x1), sign * (x0 - x2) };
+	float c[3] = { -(a[0] * x0 + b[0] * y0), -(a[1] * x1 + b[1] * y1), -(a[2] * x2 + b[2] * y2) };
+
+	// depth plane z = zx * x + zy * y + z0
+	float zx = ((triangle.z[1] - triangle.z[0]) * (y2 - y0) - (triangle.z[2] - triangle.z[0]) * (y1 - y0)) / area;
+	float zy = ((triangle.z[2] - triangle.z[0]) * (x1 - x0) - (triangle.z[1] - triangle.z[0]) * (x2 - x0)) / area;
+	float zc = triangle.z[0] - zx * x0 - zy * y0;
+
+	// bounding box inside the tile, starting on a multiple of eight pixels
+	float minX = std::min(std::min(x0, x1), x2), maxX = std::max(std::max(x0, x1), x2);
+	float minY = std::min(std::min(y0, y1), y2), maxY = std::max(std::max(y0, y1), y2);
+	GLint startX = std::max((GLint)tileX0, (GLint)minX) & ~7;
+	GLint endX = std::min((GLint)(tileX0 + TILE_WIDTH), (GLint)maxX + 1);
+	GLint startY = std::max((GLint)tileY0, (GLint)minY);
+	GLint endY = std::min((GLint)(tileY0 + TILE_HEIGHT), (GLint)maxY + 1);
+
+	for (GLint y = startY; y < endY; y++)
+	{
+		float pixelY = y + 0.5f;
+		float* row = &mDepth[y * WIDTH];
+
+#ifdef SIMDMATH_AVX
+		__m256 rowE0 = _mm256_set1_ps(b[0] * pixelY + c[0]);
+		__m256 rowE1 = _mm256_set1_ps(b[1] * pixelY + c[1]);
+		__m256 rowE2 = _mm256_set1_ps(b[2] * pixelY + c[2]);
+		__m256 rowZ = _mm256_set1_ps(zy * pixelY + zc);
+		__m256 a0 = _mm256_set1_ps(a[0]), a1 = _mm256_set1_ps(a[1]), a2 = _mm256_set1_ps(a[2]);
+		__m256 depthX = _mm256_set1_ps(zx);
+		__m256 zero = _mm256_setzero_ps();
+
+		for (GLint x = startX; x < endX; x += 8)
+		{
+			__m256 pixelX = _mm256_add_ps(_mm256_set1_ps((float)x), _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f));
+
+			__m256 e0 = _mm256_add_ps(_mm256_mul_ps(a0, pixelX), rowE0);
+			__m256 e1 = _mm256_add_ps(_mm256_mul_ps(a1, pixelX), rowE1);
+			__m256 e2 = _mm256_add_ps(_mm256_mul_ps(a2, pixelX), rowE2);
+			__m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(e0, zero, _CMP_GE_OQ), _mm256_cmp_ps(e1, zero, _CMP_GE_OQ)),
+				_mm256_cmp_ps(e2, zero, _CMP_GE_OQ));
+			if (_mm256_movemask_ps(inside) == 0)
+				continue;
+
+			__m256 depth = _mm256_add_ps(_mm256_mul_ps(depthX, pixelX), rowZ);
+			__m256 current = _mm256_loadu_ps(row + x);
+			_mm256_storeu_ps(row + x, _mm256_blendv_ps(current, _mm256_min_ps(current, depth), inside));
+		}
+#else
+		for (GLint x = startX; x < endX; x++)
+		{
+			float pixelX = x + 0.5f;
+			if (a[0] * pixelX + b[0] * pixelY + c[0] < 0.0f ||
+				a[1] * pixelX + b[1] * pixelY + c[1] < 0.0f ||
+				a[2] * pixelX + b[2] * pixelY + c[2] < 0.0f)
+				continue;
+			row[x] = std::min(row[x], zx * pixelX + zy * pixelY + zc);
+		}
+#endif
+	}
+}
+
+///////////////////////////////////////////////////
+//	IsVisible(const glm::vec3&, const glm::vec3&)
+//
+//	The box is hidden when its nearest point is behind
+//	the stored depth of every pixel its screen rectangle
+//	covers. Blocks whose farthest depth is nearer than the
+//	box settle their pixels at once.
+///////////////////////////////////////////////////
+bool OcclusionBuffer::IsVisible(const glm::vec3& boxMin, const glm::vec3& boxMax) const
+{
+	float minX = 1.0e30f, minY = 1.0e30f, maxX = -1.0e30f, maxY = -1.0e30f;
+	float nearest = 1.0f;
+	for (int corner = 0; corner < 8; corner++)
+	{
+		glm::vec3 point((corner & 1) ? boxMax.x : boxMin.x, (corner & 2) ? boxMax.y : boxMin.y, (corner & 4) ? boxMax.z : boxMin.z);
+		glm::vec4 clip = mViewProjection * glm::vec4(point, 1.0f);
+		if (clip.w < NEAR_W)
+			return true;	// reaches behind the eye
+
+		float inverseW = 1.0f / clip.w;
+		float x = (clip.x * inverseW * 0.5f + 0.5f) * WIDTH;
+		float y = (clip.y * inverseW * 0.5f + 0.5f) * HEIGHT;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		nearest = std::min(nearest, clip.z * inverseW * 0.5f + 0.5f);
+	}
+
+	// off screen boxes are the frustum test's business
+	if (maxX < 0.0f || maxY < 0.0f || minX >= WIDTH || minY >= HEIGHT)
+		return true;
+
+	GLint x0 = std::max((GLint)minX, 0), x1 = std::min((GLint)maxX, (GLint)WIDTH - 1);
+	GLint y0 = std::max((GLint)minY, 0), y1 = std::min((GLint)maxY, (GLint)HEIGHT - 1);
+
+	const GLint blocksPerRow = WIDTH / BLOCK_SIZE;
+	for (GLint blockY = y0 / BLOCK_SIZE; blockY <= y1 / (GLint)BLOCK_SIZE; blockY++)
+	{
+		for (GLint blockX = x0 / BLOCK_SIZE; blockX <= x1 / (GLint)BLOCK_SIZE; blockX++)
+		{
+			if (mBlockMax[blockY * blocksPerRow + blockX] < nearest)
+				continue;
+
+			GLint px0 = std::max(x0, blockX * (GLint)BLOCK_SIZE), px1 = std::min(x1, blockX * (GLint)BLOCK_SIZE + (GLint)BLOCK_SIZE - 1);
+			GLint py0 = std::max(y0, blockY * (GLint)BLOCK_SIZE), py1 = std::min(y1, blockY * (GLint)BLOCK_SIZE + (GLint)BLOCK_SIZE - 1);
+			for (GLint y = py0; y <= py1; y++)
+			{
+				for (GLint x = px0; x <= px1; x++)
+				{
+					if (mDepth[y * WIDTH + x] >= nearest)
+						return true;
+				}
+			}
+		}
+	}
+	return false;
+}
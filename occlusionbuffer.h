@@ -0,0 +1,72 @@
+///////////////////////////////////////////////////////////////////////////////
+// occlusionbuffer.h
+// ========
+// low resolution CPU depth buffer of occluder proxies, for occlusion culling
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "jobsystem.h"
+
+// Simplified stand-in for an object, drawn into the occlusion buffer. It must lie
+// inside the object it stands for, or it will hide things that are visible.
+struct OccluderMesh
+{
+	std::vector<glm::vec3> vertices;
+	std::vector<GLuint> indices;	// Triangle list
+};
+
+class OcclusionBuffer
+{
+public:
+	static const GLuint WIDTH = 256;
+	static const GLuint HEIGHT = 128;
+	// Unit of work of Rasterize()
+	static const GLuint TILE_WIDTH = 64;
+	static const GLuint TILE_HEIGHT = 32;
+	static const GLuint TILES_X = WIDTH / TILE_WIDTH;
+	static const GLuint TILES_Y = HEIGHT / TILE_HEIGHT;
+	// Pixels summarized by one entry of the hierarchical level
+	static const GLuint BLOCK_SIZE = 8;
+
+	// Statistics of the current frame
+	GLuint nTriangles = 0;
+
+public:
+	// Start a frame seen through viewProjection, forgetting every occluder
+	void Begin(const glm::mat4& viewProjection);
+
+	// Project an occluder's triangles and sort them into the screen tiles they touch.
+	// Triangles crossing the near plane are dropped, which only loses occlusion.
+	void AddOccluder(const OccluderMesh& mesh, const glm::mat4& model);
+
+	// Rasterize the occluders, one job per screen tile, and build the hierarchical level
+	void Rasterize(JobSystem& jobs);
+
+	// False when the world space box is certainly hidden behind the occluders
+	bool IsVisible(const glm::vec3& boxMin, const glm::vec3& boxMax) const;
+
+private:
+	// Screen position in pixels and depth in [0, 1] of each corner
+	struct ScreenTriangle
+	{
+		float x[3];
+		float y[3];
+		float z[3];
+	};
+
+	glm::mat4 mViewProjection = glm::mat4(1.0f);
+	std::vector<float> mDepth;					// WIDTH x HEIGHT, nearest occluder depth, 1 where empty
+	std::vector<float> mBlockMax;				// Farthest depth of every BLOCK_SIZE square
+	std::vector<ScreenTriangle> mTriangles;
+	std::vector<std::vector<GLuint>> mBins;		// Triangles touching each tile
+
+	void URasterizeTile(GLuint tile);
+	void URasterizeTriangle(const ScreenTriangle& triangle, GLuint tileX0, GLuint tileY0);
+};
@@ -0,0 +1,170 @@
+///////////////////////////////////////////////////////////////////////////////
+// occlusionqueries.cpp
+// ========
+// per-entity GPU occlusion queries on bounding boxes, read back without waiting
+//
+// Every entity owns one GL_ANY_SAMPLES_PASSED_CONSERVATIVE query in each
+// of LATENCY slots, and each frame uses the next slot. Results are only
+// collected once the driver reports them available, the newest first,
+// so the CPU learns about visibility a frame or two late but never waits.
+// The frame's own query still decides its draws at once on the GPU,
+// through conditional rendering.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "occlusionqueries.h"
+#include "glstate.h"
+
+bool OcclusionQueries::Create(GLuint maxEntities)
+{
+	Destroy();
+
+	mCapacity = maxEntities;
+	for (GLuint slot = 0; slot < LATENCY; slot++)
+	{
+		mQueries[slot].assign(maxEntities, 0);
+		mIssued[slot].assign(maxEntities, 0);
+		if (maxEntities > 0)
+			glGenQueries(maxEntities, mQueries[slot].data());
+	}
+	mResolved.assign(maxEntities, 0);
+	mVisible.assign(maxEntities, 1);
+	mFrame = 0;
+
+	// corners numbered by the bits of their x, y and z signs
+	GLfloat vertices[8 * 3];
+	for (int corner = 0; corner < 8; corner++)
+	{
+		vertices[corner * 3 + 0] = (corner & 1) ? 1.0f : -1.0f;
+		vertices[corner * 3 + 1] = (corner & 2) ? 1.0f : -1.0f;
+		vertices[corner * 3 + 2] = (corner & 4) ? 1.0f : -1.0f;
+	}
+	const GLuint indices[36] = {
+		0, 2, 6, 0, 6, 4,	1, 5, 7, 1, 7, 3,
+		0, 4, 5, 0, 5, 1,	2, 3, 7, 2, 7, 6,
+		0, 1, 3, 0, 3, 2,	4, 6, 7, 4, 7, 5
+	};
+
+	glGenVertexArrays(1, &mVao);
+	gGLState.BindVertexArray(mVao);
+
+	glGenBuffers(1, &mVertexBuffer);
+	gGLState.BindBuffer(GL_ARRAY_BUFFER, mVertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &mIndexBuffer);
+	gGLState.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer);	// recorded in the VAO
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 3, 0);
+	glEnableVertexAttribArray(0);
+
+	gGLState.BindVertexArray(0);
+	gGLState.BindBuffer(GL_ARRAY_BUFFER, 0);
+
+	return mVao != 0 && (maxEntities == 0 || mQueries[0][0] != 0);
+}
+
+void OcclusionQueries::Destroy()
+{
+	for (GLuint slot = 0; slot < LATENCY; slot++)
+	{
+		if (!mQueries[slot].empty())
+			glDeleteQueries((GLsizei)mQueries[slot].size(), mQueries[slot].data());
+		mQueries[slot].clear();
+		mIssued[slot].clear();
+	}
+	mResolved.clear();
+	mVisible.clear();
+	mCapacity = 0;
+
+	gGLState.DeleteVertexArrays(1, &mVao);
+	gGLState.DeleteBuffers(1, &mVertexBuffer);
+	gGLState.DeleteBuffers(1, &mIndexBuffer);
+	mVao = mVertexBuffer = mIndexBuffer = 0;
+}
+
+///////////////////////////////////////////////////
+//	BeginFrame()
+//
+//	For each entity the queries of the last LATENCY - 1
+//	frames are checked newest first, and the first one
+//	available replaces the stored result unless that is
+//	already as recent. Queries of the frame before are
+//	often still in flight and are skipped, not waited for.
+///////////////////////////////////////////////////
+void OcclusionQueries::BeginFrame()
+{
+	mFrame++;
+	nQueries = 0;
+
+	for (GLuint entity = 0; entity < mCapacity; entity++)
+	{
+		for (GLuint age = 1; age < LATENCY && age < mFrame; age++)
+		{
+			GLuint frame = mFrame - age;
+			if (frame <= mResolved[entity])
+				break;
+
+			GLuint slot = frame % LATENCY;
+			if (mIssued[slot][entity] != frame)
+				continue;
+
+			GLuint available = 0;
+			glGetQueryObjectuiv(mQueries[slot][entity], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				continue;
+
+			GLuint passed = 0;
+			glGetQueryObjectuiv(mQueries[slot][entity], GL_QUERY_RESULT, &passed);
+			mVisible[entity] = passed != 0;
+			mResolved[entity] = frame;
+			break;
+		}
+	}
+}
+
+bool OcclusionQueries::WasVisible(Entity entity) const
+{
+	return entity >= mCapacity || mVisible[entity] != 0;
+}
+
+void OcclusionQueries::BeginQuery(Entity entity)
+{
+	if (entity >= mCapacity)
+		return;
+
+	GLuint slot = USlot();
+	glBeginQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, mQueries[slot][entity]);
+	mIssued[slot][entity] = mFrame;
+	mActive = true;
+	nQueries++;
+}
+
+void OcclusionQueries::EndQuery()
+{
+	if (!mActive)
+		return;
+
+	glEndQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE);
+	mActive = false;
+}
+
+void OcclusionQueries::DrawBox() const
+{
+	gGLState.BindVertexArray(mVao);
+	glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+}
+
+bool OcclusionQueries::BeginConditionalRender(Entity entity) const
+{
+	if (entity >= mCapacity || mIssued[USlot()][entity] != mFrame)
+		return false;
+
+	glBeginConditionalRender(mQueries[USlot()][entity], GL_QUERY_NO_WAIT);
+	return true;
+}
+
+void OcclusionQueries::EndConditionalRender() const
+{
+	glEndConditionalRender();
+}
@@ -0,0 +1,63 @@
+///////////////////////////////////////////////////////////////////////////////
+// occlusionqueries.h
+// ========
+// per-entity GPU occlusion queries on bounding boxes, read back without waiting
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <vector>
+
+#include "ecs.h"
+
+class OcclusionQueries
+{
+public:
+	// Frames a query is kept before its slot is reused
+	static const GLuint LATENCY = 3;
+
+	// Statistics of the current frame
+	GLuint nQueries = 0;
+
+public:
+	// Queries for entities numbered below maxEntities, and the unit box they draw
+	bool Create(GLuint maxEntities);
+	void Destroy();
+
+	// Move to the next query slot and take in every result of earlier frames that is
+	// already available. Never waits for the GPU.
+	void BeginFrame();
+
+	// Latest known result of the entity's box test; true until one arrives
+	bool WasVisible(Entity entity) const;
+
+	// Bracket the entity's box draw with this frame's query
+	void BeginQuery(Entity entity);
+	void EndQuery();
+
+	// Draw the box from -1 to 1 with the bound program, position at attribute 0
+	void DrawBox() const;
+
+	// Bracket draws that only happen when this frame's query of the entity passed.
+	// The GPU draws anyway if the result is not ready, so it never waits either.
+	// False, with nothing to end, when the entity was not queried this frame.
+	bool BeginConditionalRender(Entity entity) const;
+	void EndConditionalRender() const;
+
+private:
+	GLuint mVao = 0;
+	GLuint mVertexBuffer = 0;
+	GLuint mIndexBuffer = 0;
+
+	GLuint mCapacity = 0;
+	GLuint mFrame = 0;							// Frames since Create(), 0 before the first
+	std::vector<GLuint> mQueries[LATENCY];		// One query per entity in each slot
+	std::vector<GLuint> mIssued[LATENCY];		// Frame each query was last issued, 0 if never
+	std::vector<GLuint> mResolved;				// Frame of the result in mVisible
+	std::vector<unsigned char> mVisible;
+	bool mActive = false;						// A query is open
+
+	GLuint USlot() const { return mFrame % LATENCY; }
+};
@@ -0,0 +1,242 @@
+///////////////////////////////////////////////////////////////////////////////
+// renderqueue.cpp
+// ========
+// draw packets ordered by a 64-bit sort key, executed with minimal state changes
+//
+// The expensive state sits in the high bits of the key, so after sorting,
+// packets sharing a program, texture and mesh are neighbours and each bind
+// is issued once per distinct value rather than once per object. Depth in
+// the low bits puts opaque objects front to back inside a state group, which
+// lets early depth testing reject hidden fragments. The keys are ordered
+// with an LSD radix sort, linear in the number of packets.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "renderqueue.h"
+#include "glstate.h"
+
+#include <algorithm>
+
+namespace
+{
+	const GLuint PASS_BITS = 4;
+	const GLuint PROGRAM_BITS = 12;
+	const GLuint TEXTURE_BITS = 12;
+	const GLuint GEOMETRY_BITS = 12;
+	const GLuint DEPTH_BITS = 24;
+
+	GLuint64 Field(GLuint value, GLuint bits, GLuint shift)
+	{
+		return (GLuint64)(value & ((1u << bits) - 1)) << shift;
+	}
+}
+
+void RenderQueue::Begin()
+{
+	mPackets.clear();
+}
+
+void RenderQueue::Submit(const DrawPacket& packet)
+{
+	mPackets.push_back(packet);
+}
+
+GLuint64 RenderQueue::MakeKey(GLuint pass, GLuint program, GLuint texture, GLuint geometry, GLuint depth)
+{
+	GLuint shift = DEPTH_BITS;
+	GLuint64 key = Field(depth, DEPTH_BITS, 0);
+	key |= Field(geometry, GEOMETRY_BITS, shift);
+	shift += GEOMETRY_BITS;
+	key |= Field(texture, TEXTURE_BITS, shift);
+	shift += TEXTURE_BITS;
+	key |= Field(program, PROGRAM_BITS, shift);
+	shift += PROGRAM_BITS;
+	key |= Field(pass, PASS_BITS, shift);
+	return key;
+}
+
+///////////////////////////////////////////////////
+//	Execute(SceneBuffers&)
+//
+//	buffers: receives the object data of every packet
+//
+//	Packets keep their key order; a draw is issued for
+//	every run of packets sharing all state, instanced
+//	over the run through the base instance
+///////////////////////////////////////////////////
+void RenderQueue::Execute(SceneBuffers& buffers)
+{
+	nPackets = (GLuint)mPackets.size();
+	nDrawCalls = 0;
+	nStateChanges = 0;
+
+	if (mPackets.empty())
+	{
+		mObjects.clear();
+		return;
+	}
+
+	mEntries.resize(mPackets.size());
+	for (GLuint i = 0; i < mPackets.size(); i++)
+	{
+		const DrawPacket& packet = mPackets[i];
+		mEntries[i].key = MakeKey(packet.pass, packet.programId, packet.textureId, UGeometryId(packet), UDepthBits(packet));
+		mEntries[i].packet = i;
+	}
+	URadixSort();
+
+	// a full ring section draws fewer packets rather than overwrite data in flight
+	GLuint count = std::min<GLuint>((GLuint)mPackets.size(), buffers.objectCapacity);
+	mObjects.resize(std::min(count, buffers.StreamRoom(sizeof(ObjectData), 1)));
+	for (GLuint i = 0; i < mObjects.size(); i++)
+		mObjects[i] = mPackets[mEntries[i].packet].object;
+	mObjectRange = buffers.UpdateObjects(mObjects.data(), (GLuint)mObjects.size());
+
+	UDraw(0);
+}
+
+void RenderQueue::Redraw(GLuint programId)
+{
+	nDrawCalls = 0;
+	nStateChanges = 0;
+	SceneBuffers::BindObjects(mObjectRange);
+	UDraw(programId);
+}
+
+// Draw the sorted packets whose object data is in the buffer; a nonzero
+// programOverride replaces the program of every packet
+void RenderQueue::UDraw(GLuint programOverride)
+{
+	GLuint currentProgram = 0;
+	GLuint currentTexture = 0;
+	GLuint currentVao = 0;
+
+	GLuint first = 0;
+	while (first < mObjects.size())
+	{
+		const DrawPacket& packet = mPackets[mEntries[first].packet];
+
+		GLuint end = first + 1;
+		while (end < mObjects.size() && USameBatch(packet, mPackets[mEntries[end].packet]))
+			end++;
+		GLsizei instances = end - first;
+
+		GLuint programId = programOverride ? programOverride : packet.programId;
+		if (programId != currentProgram)
+		{
+			gGLState.UseProgram(programId);
+			currentProgram = programId;
+			nStateChanges++;
+		}
+		if (packet.textureId != currentTexture)
+		{
+			gGLState.ActiveTexture(GL_TEXTURE0);
+			gGLState.BindTexture(GL_TEXTURE_2D_ARRAY, packet.textureId);
+			currentTexture = packet.textureId;
+			nStateChanges++;
+		}
+		if (packet.mesh->vao != currentVao)
+		{
+			gGLState.BindVertexArray(packet.mesh->vao);
+			currentVao = packet.mesh->vao;
+			nStateChanges++;
+		}
+
+		for (int i = 0; i < packet.nRanges; i++)
+		{
+			const Meshes::DrawRange& range = packet.ranges[i];
+			if (packet.mesh->nIndices > 0)
+				glDrawElementsInstancedBaseInstance(range.mode, range.count, GL_UNSIGNED_INT, (void*)(sizeof(GLuint) * range.first), instances, first);
+			else
+				glDrawArraysInstancedBaseInstance(range.mode, range.first, range.count, instances, first);
+			nDrawCalls++;
+		}
+
+		first = end;
+	}
+
+	gGLState.BindVertexArray(0);
+}
+
+// Packets can share a draw call when everything but their object data matches
+bool RenderQueue::USameBatch(const DrawPacket& a, const DrawPacket& b)
+{
+	return a.pass == b.pass && a.programId == b.programId && a.textureId == b.textureId
+		&& a.mesh == b.mesh && USameRanges(a, b.ranges, b.nRanges);
+}
+
+bool RenderQueue::USameRanges(const DrawPacket& a, const Meshes::DrawRange* ranges, int nRanges)
+{
+	if (a.ranges == ranges)
+		return true;
+	if (a.nRanges != nRanges)
+		return false;
+
+	for (int i = 0; i < nRanges; i++)
+	{
+		const Meshes::DrawRange& ra = a.ranges[i];
+		const Meshes::DrawRange& rb = ranges[i];
+		if (ra.mode != rb.mode || ra.first != rb.first || ra.count != rb.count)
+			return false;
+	}
+	return true;
+}
+
+// Number of the packet's mesh + drawing commands, assigned on first use
+GLuint RenderQueue::UGeometryId(const DrawPacket& packet)
+{
+	for (GLuint i = 0; i < mGeometries.size(); i++)
+	{
+		const Geometry& geometry = mGeometries[i];
+		if (geometry.mesh == packet.mesh && USameRanges(packet, geometry.ranges, geometry.nRanges))
+			return i;
+	}
+
+	mGeometries.push_back({ packet.mesh, packet.ranges, packet.nRanges });
+	return (GLuint)mGeometries.size() - 1;
+}
+
+// Depth quantized to DEPTH_BITS, reversed for translucent packets so the farthest sort first
+GLuint RenderQueue::UDepthBits(const DrawPacket& packet) const
+{
+	const GLuint maxValue = (1u << DEPTH_BITS) - 1;
+
+	float normalized = std::min(std::max(packet.depth / maxDepth, 0.0f), 1.0f);
+	GLuint value = (GLuint)(normalized * maxValue);
+	return packet.pass == PASS_TRANSLUCENT ? maxValue - value : value;
+}
+
+///////////////////////////////////////////////////
+//	URadixSort()
+//
+//	Sort mEntries by key, eight bits per pass starting
+//	from the least significant byte. Passes where every
+//	key has the same byte are skipped, so keys differing
+//	in a few fields cost only a few passes.
+///////////////////////////////////////////////////
+void RenderQueue::URadixSort()
+{
+	mScratch.resize(mEntries.size());
+
+	for (GLuint shift = 0; shift < 64; shift += 8)
+	{
+		GLuint counts[256] = {};
+		for (const SortEntry& entry : mEntries)
+			counts[(entry.key >> shift) & 0xFF]++;
+
+		if (counts[(mEntries[0].key >> shift) & 0xFF] == mEntries.size())
+			continue;
+
+		GLuint offset = 0;
+		for (GLuint& count : counts)
+		{
+			GLuint n = count;
+			count = offset;
+			offset += n;
+		}
+
+		for (const SortEntry& entry : mEntries)
+			mScratch[counts[(entry.key >> shift) & 0xFF]++] = entry;
+
+		mEntries.swap(mScratch);
+	}
+}
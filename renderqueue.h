@@ -0,0 +1,92 @@
+///////////////////////////////////////////////////////////////////////////////
+// renderqueue.h
+// ========
+// draw packets ordered by a 64-bit sort key, executed with minimal state changes
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <vector>
+
+#include "meshes.h"
+#include "scenebuffers.h"
+
+// Passes run in this order; opaque packets go front to back, translucent ones back to front
+enum RenderPass
+{
+	PASS_OPAQUE = 0,
+	PASS_TRANSLUCENT = 1
+};
+
+// One object submitted for drawing this frame
+struct DrawPacket
+{
+	RenderPass pass;
+	const Meshes::GLMesh* mesh;
+	const Meshes::DrawRange* ranges;	// Drawing commands, shared by every instance of a batch
+	int nRanges;
+	GLuint programId;
+	GLuint textureId;					// GL_TEXTURE_2D_ARRAY holding the object's texture layer
+	float depth;						// View space distance, orders packets of the same state
+	ObjectData object;					// Per-instance data written to the object buffer
+};
+
+class RenderQueue
+{
+public:
+	// Statistics of the last Execute()
+	GLuint nPackets = 0;
+	GLuint nDrawCalls = 0;
+	GLuint nStateChanges = 0;	// Program, texture and VAO binds issued
+
+	float maxDepth = 100.0f;	// Depth mapped to the largest key value, usually the far plane
+
+public:
+	void Begin();
+	void Submit(const DrawPacket& packet);
+
+	// Sort the packets by key, write their object data in that order and draw them.
+	// Neighbouring packets sharing all state become instances of one draw.
+	void Execute(SceneBuffers& buffers);
+
+	// Issue the draws of the last Execute() again, all with programId, reusing the
+	// streamed object data, e.g. to shade after a depth prepass. Only valid in the
+	// frame of that Execute().
+	void Redraw(GLuint programId);
+
+	// Key layout, from the most significant bit:
+	// pass (4) | program (12) | texture (12) | geometry (12) | depth (24)
+	static GLuint64 MakeKey(GLuint pass, GLuint program, GLuint texture, GLuint geometry, GLuint depth);
+
+private:
+	struct SortEntry
+	{
+		GLuint64 key;
+		GLuint packet;
+	};
+
+	// Distinct mesh + drawing command sets seen so far, numbered for the key
+	struct Geometry
+	{
+		const Meshes::GLMesh* mesh;
+		const Meshes::DrawRange* ranges;
+		int nRanges;
+	};
+
+	std::vector<DrawPacket> mPackets;
+	std::vector<SortEntry> mEntries;
+	std::vector<SortEntry> mScratch;
+	std::vector<ObjectData> mObjects;
+	StreamRange mObjectRange;
+	std::vector<Geometry> mGeometries;
+
+	GLuint UGeometryId(const DrawPacket& packet);
+	GLuint UDepthBits(const DrawPacket& packet) const;
+	void URadixSort();
+	void UDraw(GLuint programOverride);
+
+	static bool USameBatch(const DrawPacket& a, const DrawPacket& b);
+	static bool USameRanges(const DrawPacket& a, const Meshes::DrawRange* ranges, int nRanges);
+};
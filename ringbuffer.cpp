@@ -0,0 +1,106 @@
+///////////////////////////////////////////////////////////////////////////////
+// ringbuffer.cpp
+// ========
+// persistently mapped buffer streaming per-frame data, fenced per frame
+//
+// The buffer is created with immutable storage and mapped persistent and
+// coherent, so the CPU writes straight into memory the GPU reads, with no
+// glBufferSubData copy and no reallocation. It is split into one section
+// per frame in flight. A frame bump-allocates from its section, and a
+// fence placed at the end of the frame keeps the section from being
+// overwritten until the GPU has consumed it.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ringbuffer.h"
+#include "glstate.h"
+
+#include <algorithm>
+
+namespace
+{
+	const GLbitfield STORAGE_FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	// Longest single wait on a fence before asking again, in nanoseconds
+	const GLuint64 FENCE_TIMEOUT = 1000000000;
+}
+
+///////////////////////////////////////////////////
+//	Create(GLsizeiptr)
+//
+//	frameBytes: most data one frame can stream, rounded
+//	up to the binding alignment
+///////////////////////////////////////////////////
+bool RingBuffer::Create(GLsizeiptr frameBytes)
+{
+	Destroy();
+
+	GLint uniformAlignment = 0, storageAlignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+	mAlignment = std::max(std::max(uniformAlignment, storageAlignment), 16);
+
+	frameSize = (frameBytes + mAlignment - 1) / mAlignment * mAlignment;
+
+	glGenBuffers(1, &buffer);
+	gGLState.BindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferStorage(GL_COPY_WRITE_BUFFER, frameSize * FRAMES, nullptr, STORAGE_FLAGS);
+	mMapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, frameSize * FRAMES, STORAGE_FLAGS);
+	gGLState.BindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	mSection = 0;
+	mHead = 0;
+	return buffer != 0 && mMapped != nullptr;
+}
+
+void RingBuffer::Destroy()
+{
+	for (GLuint i = 0; i < FRAMES; i++)
+	{
+		if (mFences[i])
+			glDeleteSync(mFences[i]);
+		mFences[i] = 0;
+	}
+
+	// deleting the buffer unmaps it
+	gGLState.DeleteBuffers(1, &buffer);
+	buffer = 0;
+	mMapped = nullptr;
+	frameSize = 0;
+	mHead = 0;
+}
+
+void RingBuffer::BeginFrame()
+{
+	mSection = (mSection + 1) % FRAMES;
+	mHead = 0;
+
+	GLsync fence = mFences[mSection];
+	if (!fence)
+		return;
+
+	// usually signaled long ago; the first wait also flushes in case it was never submitted
+	GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+	while (glClientWaitSync(fence, flags, FENCE_TIMEOUT) == GL_TIMEOUT_EXPIRED)
+		flags = 0;
+
+	glDeleteSync(fence);
+	mFences[mSection] = 0;
+}
+
+void RingBuffer::EndFrame()
+{
+	if (mFences[mSection])
+		glDeleteSync(mFences[mSection]);
+	mFences[mSection] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void* RingBuffer::Allocate(GLsizeiptr size, GLintptr& offset)
+{
+	GLsizeiptr start = (mHead + mAlignment - 1) / mAlignment * mAlignment;
+	if (!mMapped || size <= 0 || start + size > frameSize)
+		return nullptr;
+
+	mHead = start + size;
+	offset = mSection * frameSize + start;
+	return mMapped + offset;
+}
@@ -0,0 +1,47 @@
+///////////////////////////////////////////////////////////////////////////////
+// ringbuffer.h
+// ========
+// persistently mapped buffer streaming per-frame data, fenced per frame
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+class RingBuffer
+{
+public:
+	// Frames the CPU may write ahead of the GPU, each with its own section
+	static const GLuint FRAMES = 3;
+
+	GLuint buffer = 0;
+	GLsizeiptr frameSize = 0;	// Bytes of one frame's section
+
+public:
+	// Allocate FRAMES sections of frameBytes, mapped once for the buffer's lifetime
+	bool Create(GLsizeiptr frameBytes);
+	void Destroy();
+
+	// Move to the next section, waiting only if the GPU still reads what was written
+	// there FRAMES frames ago
+	void BeginFrame();
+
+	// Fence the frame's commands, which protects the section until they complete
+	void EndFrame();
+
+	// Reserve size bytes of the current section, aligned for uniform, storage and
+	// indirect bindings. Returns the memory to write and its offset in buffer, or
+	// nullptr when the section is full.
+	void* Allocate(GLsizeiptr size, GLintptr& offset);
+
+	// Bytes of the current section still free, before alignment
+	GLsizeiptr Available() const { return frameSize - mHead; }
+	GLint Alignment() const { return mAlignment; }
+
+private:
+	unsigned char* mMapped = nullptr;
+	GLsync mFences[FRAMES] = {};
+	GLuint mSection = 0;
+	GLsizeiptr mHead = 0;		// Next free byte of the current section
+	GLint mAlignment = 16;
+};
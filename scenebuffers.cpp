@@ -0,0 +1,117 @@
+///////////////////////////////////////////////////////////////////////////////
+// scenebuffers.cpp
+// ========
+// per-frame uniform block and per-object storage buffer shared by shaders
+//
+// Frame constants (camera, lights) are an std140 uniform block that every
+// program binds at FRAME_BINDING. Per-object constants are an std430
+// storage block at OBJECT_BINDING, indexed in the vertex shader by a draw
+// id derived from the draw's base instance, so drawing an object needs no
+// uniform calls at all. Both are written into a persistently mapped ring
+// buffer and bound as ranges of it, so uploads are plain memory copies.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "scenebuffers.h"
+#include "glstate.h"
+
+#include <cstring>
+#include <vector>
+
+static_assert(sizeof(FrameData) == 208, "FrameData must match the std140 FrameBlock layout");
+static_assert(sizeof(ObjectData) % 16 == 0, "ObjectData must match the std430 ObjectBlock stride");
+
+///////////////////////////////////////////////////
+//	Create(GLuint, GLsizeiptr)
+//
+//	maxObjects: most objects one upload can hold, and
+//	the size of the draw id range
+//	streamBytes: size of each frame's ring section
+///////////////////////////////////////////////////
+bool SceneBuffers::Create(GLuint maxObjects, GLsizeiptr streamBytes)
+{
+	objectCapacity = maxObjects;
+
+	if (!ring.Create(streamBytes))
+		return false;
+
+	// identity stream: instance i reads the value i
+	std::vector<GLuint> ids(maxObjects);
+	for (GLuint i = 0; i < maxObjects; i++)
+		ids[i] = i;
+
+	glGenBuffers(1, &drawIdBuffer);
+	gGLState.BindBuffer(GL_ARRAY_BUFFER, drawIdBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLuint) * ids.size(), ids.data(), GL_STATIC_DRAW);
+	gGLState.BindBuffer(GL_ARRAY_BUFFER, 0);
+
+	return drawIdBuffer != 0;
+}
+
+void SceneBuffers::Destroy()
+{
+	ring.Destroy();
+	gGLState.DeleteBuffers(1, &drawIdBuffer);
+	drawIdBuffer = 0;
+	objectCapacity = 0;
+}
+
+void SceneBuffers::AttachDrawId(GLuint vao) const
+{
+	gGLState.BindVertexArray(vao);
+	glVertexAttribIFormat(DRAW_ID_ATTRIBUTE, 1, GL_UNSIGNED_INT, 0);
+	glVertexAttribBinding(DRAW_ID_ATTRIBUTE, DRAW_ID_ATTRIBUTE);
+	glVertexBindingDivisor(DRAW_ID_ATTRIBUTE, 1);
+	glBindVertexBuffer(DRAW_ID_ATTRIBUTE, drawIdBuffer, 0, sizeof(GLuint));
+	glEnableVertexAttribArray(DRAW_ID_ATTRIBUTE);
+	gGLState.BindVertexArray(0);
+}
+
+void SceneBuffers::UpdateFrame(const FrameData& frame)
+{
+	StreamRange range = Stream(&frame, sizeof(FrameData));
+	if (range.size > 0)
+		gGLState.BindBufferRange(GL_UNIFORM_BUFFER, FRAME_BINDING, range.buffer, range.offset, range.size);
+}
+
+///////////////////////////////////////////////////
+//	UpdateObjects(const ObjectData*, GLuint)
+//
+//	Writes at most objectCapacity entries, and none when
+//	the frame's section is full; the returned range's
+//	size tells how many went in
+///////////////////////////////////////////////////
+StreamRange SceneBuffers::UpdateObjects(const ObjectData* objects, GLuint count)
+{
+	if (count > objectCapacity)
+		count = objectCapacity;
+
+	StreamRange range = Stream(objects, sizeof(ObjectData) * count);
+	if (range.size > 0)
+		BindObjects(range);
+	return range;
+}
+
+void SceneBuffers::BindObjects(const StreamRange& range)
+{
+	if (range.size > 0)
+		gGLState.BindBufferRange(GL_SHADER_STORAGE_BUFFER, OBJECT_BINDING, range.buffer, range.offset, range.size);
+}
+
+StreamRange SceneBuffers::Stream(const void* data, GLsizeiptr size)
+{
+	StreamRange range;
+	void* memory = ring.Allocate(size, range.offset);
+	if (!memory)
+		return range;
+
+	memcpy(memory, data, size);
+	range.buffer = ring.buffer;
+	range.size = size;
+	return range;
+}
+
+GLuint SceneBuffers::StreamRoom(GLsizeiptr itemBytes, GLuint nAllocations) const
+{
+	GLsizeiptr room = ring.Available() - (GLsizeiptr)ring.Alignment() * nAllocations;
+	return room > 0 ? (GLuint)(room / itemBytes) : 0;
+}
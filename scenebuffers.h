@@ -0,0 +1,86 @@
+///////////////////////////////////////////////////////////////////////////////
+// scenebuffers.h
+// ========
+// per-frame uniform block and per-object storage buffer shared by shaders
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "ringbuffer.h"
+
+// std140 layout of the FrameBlock uniform block, written once per frame
+struct FrameData
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec4 lightPosition[2];	// xyz used
+	glm::vec4 lightColor[2];	// rgb used
+	glm::vec4 viewPosition;		// xyz used
+};
+
+// std430 layout of one entry of the ObjectBlock storage buffer
+struct ObjectData
+{
+	glm::mat4 model;
+	glm::vec4 normalMatrix[3];	// mat3 columns, padded to vec4 as std430 requires
+	glm::vec4 color;			// rgb used
+	glm::vec2 uvScale;
+	GLuint textureIndex;
+	GLint aoBase;				// Added to gl_VertexID to index the AO storage buffer
+};
+
+// Data streamed through the ring buffer this frame
+struct StreamRange
+{
+	GLuint buffer = 0;
+	GLintptr offset = 0;
+	GLsizeiptr size = 0;		// 0 when nothing was written
+};
+
+class SceneBuffers
+{
+public:
+	// Binding points of the blocks and location of the per-instance draw id attribute.
+	// The draw id reads an identity buffer with a divisor of one, so a draw issued
+	// with base instance N sees drawId == N (+ gl_InstanceID for instanced draws).
+	static const GLuint FRAME_BINDING = 0;
+	static const GLuint OBJECT_BINDING = 1;
+	static const GLuint AO_BINDING = 2;
+	static const GLuint DRAW_ID_ATTRIBUTE = 4;
+
+	GLuint drawIdBuffer = 0;
+	GLuint objectCapacity = 0;
+
+	// Frame constants, object data and draw commands of the frames in flight
+	RingBuffer ring;
+
+public:
+	// streamBytes: most data a single frame streams, frame block included
+	bool Create(GLuint maxObjects, GLsizeiptr streamBytes);
+	void Destroy();
+
+	// Bracket each frame's uploads and draws
+	void BeginFrame() { ring.BeginFrame(); }
+	void EndFrame() { ring.EndFrame(); }
+
+	// Add the draw id attribute to a mesh VAO
+	void AttachDrawId(GLuint vao) const;
+
+	void UpdateFrame(const FrameData& frame);
+
+	// Stream count entries and bind them at OBJECT_BINDING, so drawId 0 reads the
+	// first. Each call gets fresh memory and leaves earlier draws' data alone.
+	StreamRange UpdateObjects(const ObjectData* objects, GLuint count);
+	static void BindObjects(const StreamRange& range);
+
+	// Copy bytes into this frame's section, e.g. indirect commands
+	StreamRange Stream(const void* data, GLsizeiptr size);
+
+	// Items of itemBytes each that still fit in this frame's section, split over
+	// nAllocations allocations
+	GLuint StreamRoom(GLsizeiptr itemBytes, GLuint nAllocations) const;
+};
@@ -0,0 +1,113 @@
+///////////////////////////////////////////////////////////////////////////////
+// scenegraph.cpp
+// ========
+// transform hierarchy in a flat depth-first array with cached world matrices
+//
+// In depth-first order every parent precedes its children and a node's
+// descendants are the subtreeSize entries right after it. One forward pass
+// therefore sees each parent's final world matrix before its children,
+// and a dirty node can mark its whole subtree with a single range.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "scenegraph.h"
+#include "simdmath.h"
+
+#include <algorithm>
+
+int SceneGraph::AddNode(int parent, const Transform& local)
+{
+	int node = (int)mParents.size();
+
+	if (parent >= node)
+		return -1;
+
+	// depth first: the parent's subtree must end at the current last node
+	if (parent >= 0 && parent + (int)mSubtreeSizes[parent] != node - 1)
+		return -1;
+
+	mLocals.push_back(local);
+	mWorlds.push_back(glm::mat4(1.0f));
+	mParents.push_back(parent);
+	mSubtreeSizes.push_back(0);
+	mDirty.push_back(1);
+	mChangedFlags.push_back(0);
+
+	for (int ancestor = parent; ancestor >= 0; ancestor = mParents[ancestor])
+		mSubtreeSizes[ancestor]++;
+
+	if (!mAnyDirty)
+		mFirstDirty = node;
+	mAnyDirty = true;
+
+	return node;
+}
+
+void SceneGraph::Clear()
+{
+	mLocals.clear();
+	mWorlds.clear();
+	mParents.clear();
+	mSubtreeSizes.clear();
+	mDirty.clear();
+	mChanged.clear();
+	mChangedFlags.clear();
+	mFirstDirty = 0;
+	mAnyDirty = false;
+}
+
+void SceneGraph::SetLocal(int node, const Transform& local)
+{
+	mLocals[node] = local;
+	mDirty[node] = 1;
+
+	if (!mAnyDirty || (GLuint)node < mFirstDirty)
+		mFirstDirty = node;
+	mAnyDirty = true;
+}
+
+///////////////////////////////////////////////////
+//	Update()
+//
+//	Walk forward from the first dirty node. A dirty
+//	node pushes the end of the range to recompute past
+//	its subtree; clean nodes outside every such range
+//	are skipped.
+///////////////////////////////////////////////////
+GLuint SceneGraph::Update()
+{
+	for (GLuint node : mChanged)
+		mChangedFlags[node] = 0;
+	mChanged.clear();
+
+	if (!mAnyDirty)
+		return 0;
+
+	GLuint recomputeEnd = mFirstDirty;
+	for (GLuint node = mFirstDirty; node < mParents.size(); node++)
+	{
+		if (mDirty[node])
+			recomputeEnd = std::max<GLuint>(recomputeEnd, node + mSubtreeSizes[node] + 1);
+
+		if (node >= recomputeEnd)
+			continue;
+
+		glm::mat4 local = UCompose(mLocals[node]);
+		int parent = mParents[node];
+		if (parent >= 0)
+			SimdMath::MultiplyAffine(&mWorlds[parent], &local, &mWorlds[node], 1);
+		else
+			mWorlds[node] = local;
+		mDirty[node] = 0;
+		mChangedFlags[node] = 1;
+		mChanged.push_back(node);
+	}
+
+	mAnyDirty = false;
+	return (GLuint)mChanged.size();
+}
+
+glm::mat4 SceneGraph::UCompose(const Transform& local)
+{
+	// transformations are applied right-to-left: scale, then rotate, then translate
+	return SimdMath::ComposeTRS(local.position, local.rotation, local.scale);
+}
@@ -0,0 +1,64 @@
+///////////////////////////////////////////////////////////////////////////////
+// scenegraph.h
+// ========
+// transform hierarchy in a flat depth-first array with cached world matrices
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+
+class SceneGraph
+{
+public:
+	// Local transform, applied as translation * rotation * scale
+	struct Transform
+	{
+		glm::vec3 scale;
+		glm::quat rotation;	// Unit quaternion
+		glm::vec3 position;
+	};
+
+public:
+	// Append a node under parent (-1 for a root) and return its index. Nodes have to
+	// be added depth first: parent must be the last node added or one of its ancestors.
+	// Returns -1 otherwise.
+	int AddNode(int parent, const Transform& local);
+	void Clear();
+
+	// Replace a node's local transform; its subtree is recomputed by the next Update()
+	void SetLocal(int node, const Transform& local);
+
+	// Recompute the world matrices of dirty nodes and their subtrees. Returns the
+	// number of nodes recomputed; a scene where nothing moved costs one branch.
+	GLuint Update();
+
+	const Transform& Local(int node) const { return mLocals[node]; }
+	const glm::mat4& World(int node) const { return mWorlds[node]; }
+	int Parent(int node) const { return mParents[node]; }
+	GLuint Size() const { return (GLuint)mParents.size(); }
+
+	// Nodes recomputed by the last Update(), in depth-first order
+	const std::vector<GLuint>& Changed() const { return mChanged; }
+	bool WasChanged(int node) const { return mChangedFlags[node] != 0; }
+
+private:
+	// Node data as parallel arrays, indexed by depth-first position
+	std::vector<Transform> mLocals;
+	std::vector<glm::mat4> mWorlds;
+	std::vector<int> mParents;
+	std::vector<GLuint> mSubtreeSizes;	// Number of descendants, which directly follow the node
+	std::vector<unsigned char> mDirty;
+
+	std::vector<GLuint> mChanged;
+	std::vector<unsigned char> mChangedFlags;
+	GLuint mFirstDirty = 0;				// No node before this one is dirty
+	bool mAnyDirty = false;
+
+	static glm::mat4 UCompose(const Transform& local);
+};
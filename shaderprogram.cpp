@@ -0,0 +1,304 @@
+///////////////////////////////////////////////////////////////////////////////
+// shaderprogram.cpp
+// ========
+// compiled GLSL program with reflected uniform and block tables
+//
+// All active uniforms and blocks are queried once after linking. Setters
+// take a table handle instead of a name, go through glProgramUniform*() so
+// the program does not have to be bound, and skip the driver call when the
+// value matches the one uploaded last.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "shaderprogram.h"
+#include "glstate.h"
+
+#include <cstring>
+#include <iostream>
+
+#include <glm/gtc/type_ptr.hpp>
+
+namespace
+{
+	// Size in bytes of one element of a uniform of the given type
+	GLuint UniformTypeSize(GLenum type)
+	{
+		switch (type)
+		{
+		case GL_FLOAT_VEC2:
+		case GL_INT_VEC2:
+			return 8;
+		case GL_FLOAT_VEC3:
+		case GL_INT_VEC3:
+			return 12;
+		case GL_FLOAT_VEC4:
+		case GL_INT_VEC4:
+			return 16;
+		case GL_FLOAT_MAT3:
+			return 36;
+		case GL_FLOAT_MAT4:
+			return 64;
+		default:
+			return 4;	// scalars, booleans and samplers
+		}
+	}
+
+	// Remove the "[0]" GL appends to the name of array uniforms
+	std::string BaseName(const char* name)
+	{
+		std::string base(name);
+		size_t bracket = base.find('[');
+		if (bracket != std::string::npos)
+			base.erase(bracket);
+		return base;
+	}
+
+	bool CompileShader(GLuint shaderId, const char* source, const char* stage)
+	{
+		int success = 0;
+		char infoLog[512];
+
+		glShaderSource(shaderId, 1, &source, NULL);
+		glCompileShader(shaderId);
+		glGetShaderiv(shaderId, GL_COMPILE_STATUS, &success);
+		if (!success)
+		{
+			glGetShaderInfoLog(shaderId, sizeof(infoLog), NULL, infoLog);
+			std::cout << "ERROR::SHADER::" << stage << "::COMPILATION_FAILED\n" << infoLog << std::endl;
+			return false;
+		}
+		return true;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Create(const char*, const char*)
+//
+//	Compile and link the program, then reflect its
+//	active uniforms and blocks
+///////////////////////////////////////////////////
+bool ShaderProgram::Create(const char* vtxShaderSource, const char* fragShaderSource)
+{
+	int success = 0;
+	char infoLog[512];
+
+	// Create a Shader program object.
+	programId = glCreateProgram();
+
+	// Create the vertex and fragment shader objects
+	GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
+	GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+
+	bool compiled = CompileShader(vertexShaderId, vtxShaderSource, "VERTEX")
+		&& CompileShader(fragmentShaderId, fragShaderSource, "FRAGMENT");
+
+	if (compiled)
+	{
+		// Attached compiled shaders to the shader program
+		glAttachShader(programId, vertexShaderId);
+		glAttachShader(programId, fragmentShaderId);
+
+		glLinkProgram(programId);   // links the shader program
+	}
+
+	// the program keeps what it needs once linked
+	glDeleteShader(vertexShaderId);
+	glDeleteShader(fragmentShaderId);
+
+	if (!compiled)
+		return false;
+
+	// check for linking errors
+	glGetProgramiv(programId, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+		return false;
+	}
+
+	UReflect();
+
+	return true;
+}
+
+void ShaderProgram::Destroy()
+{
+	gGLState.DeleteProgram(programId);
+	programId = 0;
+	mUniforms.clear();
+	mValues.clear();
+	mUniformIndex.clear();
+	mUniformBlockIndex.clear();
+	mStorageBlockIndex.clear();
+}
+
+void ShaderProgram::Use() const
+{
+	gGLState.UseProgram(programId);
+}
+
+GLint ShaderProgram::Uniform(const char* name) const
+{
+	auto found = mUniformIndex.find(name);
+	return found != mUniformIndex.end() ? found->second : -1;
+}
+
+GLint ShaderProgram::UniformBlock(const char* name) const
+{
+	auto found = mUniformBlockIndex.find(name);
+	return found != mUniformBlockIndex.end() ? found->second : -1;
+}
+
+GLint ShaderProgram::StorageBlock(const char* name) const
+{
+	auto found = mStorageBlockIndex.find(name);
+	return found != mStorageBlockIndex.end() ? found->second : -1;
+}
+
+void ShaderProgram::BindUniformBlock(GLint block, GLuint binding)
+{
+	if (block >= 0)
+		glUniformBlockBinding(programId, block, binding);
+}
+
+void ShaderProgram::BindStorageBlock(GLint block, GLuint binding)
+{
+	if (block >= 0)
+		glShaderStorageBlockBinding(programId, block, binding);
+}
+
+void ShaderProgram::SetInt(GLint uniform, GLint value)
+{
+	if (UChanged(uniform, GL_INT, &value, sizeof(value)))
+		glProgramUniform1i(programId, mUniforms[uniform].location, value);
+}
+
+void ShaderProgram::SetFloat(GLint uniform, GLfloat value)
+{
+	if (UChanged(uniform, GL_FLOAT, &value, sizeof(value)))
+		glProgramUniform1f(programId, mUniforms[uniform].location, value);
+}
+
+void ShaderProgram::SetVec2(GLint uniform, const glm::vec2& value)
+{
+	if (UChanged(uniform, GL_FLOAT_VEC2, glm::value_ptr(value), sizeof(GLfloat) * 2))
+		glProgramUniform2fv(programId, mUniforms[uniform].location, 1, glm::value_ptr(value));
+}
+
+void ShaderProgram::SetVec3(GLint uniform, const glm::vec3& value)
+{
+	if (UChanged(uniform, GL_FLOAT_VEC3, glm::value_ptr(value), sizeof(GLfloat) * 3))
+		glProgramUniform3fv(programId, mUniforms[uniform].location, 1, glm::value_ptr(value));
+}
+
+void ShaderProgram::SetVec4(GLint uniform, const glm::vec4& value)
+{
+	if (UChanged(uniform, GL_FLOAT_VEC4, glm::value_ptr(value), sizeof(GLfloat) * 4))
+		glProgramUniform4fv(programId, mUniforms[uniform].location, 1, glm::value_ptr(value));
+}
+
+void ShaderProgram::SetMat3(GLint uniform, const glm::mat3& value)
+{
+	if (UChanged(uniform, GL_FLOAT_MAT3, glm::value_ptr(value), sizeof(GLfloat) * 9))
+		glProgramUniformMatrix3fv(programId, mUniforms[uniform].location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+void ShaderProgram::SetMat4(GLint uniform, const glm::mat4& value)
+{
+	if (UChanged(uniform, GL_FLOAT_MAT4, glm::value_ptr(value), sizeof(GLfloat) * 16))
+		glProgramUniformMatrix4fv(programId, mUniforms[uniform].location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+///////////////////////////////////////////////////
+//	UReflect()
+//
+//	Build the uniform table from GL_ACTIVE_UNIFORMS and
+//	the block tables from the program interface queries.
+//	Uniforms living inside blocks have no location and
+//	are left out of the table.
+///////////////////////////////////////////////////
+void ShaderProgram::UReflect()
+{
+	mUniforms.clear();
+	mValues.clear();
+	mUniformIndex.clear();
+	mUniformBlockIndex.clear();
+	mStorageBlockIndex.clear();
+
+	GLint nUniforms = 0;
+	GLint maxNameLength = 0;
+	glGetProgramiv(programId, GL_ACTIVE_UNIFORMS, &nUniforms);
+	glGetProgramiv(programId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+	std::vector<char> name(maxNameLength + 1);
+
+	for (GLint i = 0; i < nUniforms; i++)
+	{
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveUniform(programId, i, (GLsizei)name.size(), NULL, &size, &type, name.data());
+
+		GLint location = glGetUniformLocation(programId, name.data());
+		if (location < 0)
+			continue;
+
+		UniformInfo info;
+		info.location = location;
+		info.type = type;
+		info.valueOffset = (GLuint)mValues.size();
+		info.valueSize = UniformTypeSize(type) * size;
+		info.uploaded = false;
+
+		mValues.resize(mValues.size() + info.valueSize);
+		mUniformIndex[BaseName(name.data())] = (GLint)mUniforms.size();
+		mUniforms.push_back(info);
+	}
+
+	const GLenum blockInterfaces[] = { GL_UNIFORM_BLOCK, GL_SHADER_STORAGE_BLOCK };
+	for (GLenum blockInterface : blockInterfaces)
+	{
+		std::unordered_map<std::string, GLint>& table = blockInterface == GL_UNIFORM_BLOCK ? mUniformBlockIndex : mStorageBlockIndex;
+
+		GLint nBlocks = 0;
+		GLint maxBlockNameLength = 0;
+		glGetProgramInterfaceiv(programId, blockInterface, GL_ACTIVE_RESOURCES, &nBlocks);
+		glGetProgramInterfaceiv(programId, blockInterface, GL_MAX_NAME_LENGTH, &maxBlockNameLength);
+		std::vector<char> blockName(maxBlockNameLength + 1);
+
+		for (GLint i = 0; i < nBlocks; i++)
+		{
+			glGetProgramResourceName(programId, blockInterface, i, (GLsizei)blockName.size(), NULL, blockName.data());
+			table[blockName.data()] = i;
+		}
+	}
+}
+
+///////////////////////////////////////////////////
+//	UChanged(GLint, GLenum, const void*, GLuint)
+//
+//	Returns true, and remembers the value, if it differs
+//	from the last upload. Unknown handles and mismatched
+//	types return false, so nothing reaches the driver.
+///////////////////////////////////////////////////
+bool ShaderProgram::UChanged(GLint uniform, GLenum type, const void* value, GLuint size)
+{
+	if (uniform < 0 || uniform >= (GLint)mUniforms.size())
+		return false;
+
+	UniformInfo& info = mUniforms[uniform];
+
+	// samplers and booleans are set through the int setter
+	bool intLike = type == GL_INT && info.type != GL_FLOAT && UniformTypeSize(info.type) == 4;
+	if (info.type != type && !intLike)
+	{
+		std::cout << "ERROR::SHADER::UNIFORM::TYPE_MISMATCH for uniform " << uniform << std::endl;
+		return false;
+	}
+
+	unsigned char* cached = mValues.data() + info.valueOffset;
+	if (info.uploaded && memcmp(cached, value, size) == 0)
+		return false;
+
+	memcpy(cached, value, size);
+	info.uploaded = true;
+	return true;
+}
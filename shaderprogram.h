@@ -0,0 +1,65 @@
+///////////////////////////////////////////////////////////////////////////////
+// shaderprogram.h
+// ========
+// compiled GLSL program with reflected uniform and block tables
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ShaderProgram
+{
+public:
+	GLuint programId = 0;
+
+public:
+	bool Create(const char* vtxShaderSource, const char* fragShaderSource);
+	void Destroy();
+	void Use() const;
+
+	// Handle of an active uniform in the reflected table, or -1 when the uniform was
+	// optimized out. Resolve handles once after Create(), never inside the frame loop.
+	GLint Uniform(const char* name) const;
+	// Index of an active uniform or shader storage block, or -1
+	GLint UniformBlock(const char* name) const;
+	GLint StorageBlock(const char* name) const;
+
+	void BindUniformBlock(GLint block, GLuint binding);
+	void BindStorageBlock(GLint block, GLuint binding);
+
+	// Typed setters; values equal to the last upload are not sent to the driver
+	void SetInt(GLint uniform, GLint value);
+	void SetFloat(GLint uniform, GLfloat value);
+	void SetVec2(GLint uniform, const glm::vec2& value);
+	void SetVec3(GLint uniform, const glm::vec3& value);
+	void SetVec4(GLint uniform, const glm::vec4& value);
+	void SetMat3(GLint uniform, const glm::mat3& value);
+	void SetMat4(GLint uniform, const glm::mat4& value);
+
+private:
+	// One active uniform and the slice of mValues holding its last uploaded value
+	struct UniformInfo
+	{
+		GLint location;
+		GLenum type;
+		GLuint valueOffset;
+		GLuint valueSize;
+		bool uploaded;
+	};
+
+	std::vector<UniformInfo> mUniforms;
+	std::vector<unsigned char> mValues;
+	std::unordered_map<std::string, GLint> mUniformIndex;
+	std::unordered_map<std::string, GLint> mUniformBlockIndex;
+	std::unordered_map<std::string, GLint> mStorageBlockIndex;
+
+	void UReflect();
+	bool UChanged(GLint uniform, GLenum type, const void* value, GLuint size);
+};
@@ -0,0 +1,132 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadowmap.cpp
+// ========
+// shadow map of one light, with a cached static layer and a dynamic layer
+//
+// Most of the desk never moves, so its depth from the light is kept in a
+// static map that is re-rendered only when the light or a static object
+// changes. Frames with movable casters copy the static map on the GPU and
+// draw just those casters over it, so the cost of shadows follows what
+// moved rather than the size of the scene.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "shadowmap.h"
+#include "glstate.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	GLuint CreateDepthMap(GLsizei size, GLuint& framebuffer)
+	{
+		GLuint texture;
+		glGenTextures(1, &texture);
+		gGLState.BindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+
+		// sampled with sampler2DShadow, so linear filtering gives 2x2 PCF for free
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		const GLfloat border[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
+
+		glGenFramebuffers(1, &framebuffer);
+		gGLState.BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		return texture;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Create(GLsizei)
+//
+//	size: width and height of both maps in texels
+///////////////////////////////////////////////////
+bool ShadowMap::Create(GLsizei size)
+{
+	Destroy();
+	this->size = size;
+
+	gGLState.ActiveTexture(GL_TEXTURE0);
+	staticTexture = CreateDepthMap(size, staticFramebuffer);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	dynamicTexture = CreateDepthMap(size, dynamicFramebuffer);
+	complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+	gGLState.BindTexture(GL_TEXTURE_2D, 0);
+	gGLState.BindFramebuffer(GL_FRAMEBUFFER, 0);
+	return complete;
+}
+
+void ShadowMap::Destroy()
+{
+	const GLuint framebuffers[] = { staticFramebuffer, dynamicFramebuffer };
+	const GLuint textures[] = { staticTexture, dynamicTexture };
+	if (staticFramebuffer)
+	{
+		gGLState.DeleteFramebuffers(2, framebuffers);
+		gGLState.DeleteTextures(2, textures);
+	}
+
+	staticTexture = 0;
+	staticFramebuffer = 0;
+	dynamicTexture = 0;
+	dynamicFramebuffer = 0;
+	size = 0;
+	enabled = false;
+	staticValid = false;
+	hasDynamic = false;
+}
+
+bool ShadowMap::Fit(const glm::vec3& position, const glm::vec4& sceneSphere)
+{
+	lightPosition = position;
+
+	glm::vec3 center(sceneSphere);
+	glm::vec3 toCenter = center - position;
+	float distance = glm::length(toCenter);
+	float radius = sceneSphere.w;
+
+	enabled = distance > radius * 1.01f;
+	if (!enabled)
+		return false;
+
+	// any up vector not parallel to the view direction
+	glm::vec3 direction = toCenter / distance;
+	glm::vec3 up = std::fabs(direction.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+
+	float fov = 2.0f * std::asin(radius / distance);
+	float nearPlane = std::max(distance - radius, distance * 0.01f);
+	float farPlane = distance + radius;
+	viewProjection = glm::perspective(fov, 1.0f, nearPlane, farPlane) * glm::lookAt(position, center, up);
+
+	// clip space [-1, 1] to texture space [0, 1]
+	glm::mat4 bias = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)), glm::vec3(0.5f));
+	shadowMatrix = bias * viewProjection;
+	return true;
+}
+
+void ShadowMap::BeginStatic()
+{
+	gGLState.BindFramebuffer(GL_FRAMEBUFFER, staticFramebuffer);
+	gGLState.Viewport(0, 0, size, size);
+	gGLState.DepthMask(GL_TRUE);
+	glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void ShadowMap::BeginDynamic()
+{
+	glCopyImageSubData(staticTexture, GL_TEXTURE_2D, 0, 0, 0, 0, dynamicTexture, GL_TEXTURE_2D, 0, 0, 0, 0, size, size, 1);
+	gGLState.BindFramebuffer(GL_FRAMEBUFFER, dynamicFramebuffer);
+	gGLState.Viewport(0, 0, size, size);
+	hasDynamic = true;
+}
@@ -0,0 +1,48 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadowmap.h
+// ========
+// shadow map of one light, with a cached static layer and a dynamic layer
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+// Depth of the scene seen from a light through a perspective frustum fitted around
+// the scene. Static casters are drawn into their own map only when it is
+// invalidated; movable casters go into a copy of it every frame they exist.
+class ShadowMap
+{
+public:
+	GLuint staticTexture = 0;
+	GLuint staticFramebuffer = 0;
+	GLuint dynamicTexture = 0;
+	GLuint dynamicFramebuffer = 0;
+	GLsizei size = 0;
+
+	glm::vec3 lightPosition = glm::vec3(0.0f);	// Light the frustum was fitted for
+	glm::mat4 viewProjection = glm::mat4(1.0f);	// World to the light's clip space
+	glm::mat4 shadowMatrix = glm::mat4(1.0f);	// World to shadow texture coordinates and depth
+
+	bool enabled = false;		// The last Fit() found a frustum; no shadows otherwise
+	bool staticValid = false;	// staticTexture matches the light and the static casters
+	bool hasDynamic = false;	// dynamicTexture holds this frame's movable casters
+
+public:
+	bool Create(GLsizei size);
+	void Destroy();
+
+	// Aim a frustum from position at the sphere (center in xyz, radius in w) so it
+	// encloses it. Lights inside the sphere cannot see all of it and get no shadows.
+	bool Fit(const glm::vec3& position, const glm::vec4& sceneSphere);
+
+	// Bind and clear the static map for drawing static casters
+	void BeginStatic();
+	// Copy the static map into the dynamic one and bind it for drawing movable casters
+	void BeginDynamic();
+
+	// The map to sample this frame
+	GLuint Texture() const { return hasDynamic ? dynamicTexture : staticTexture; }
+};
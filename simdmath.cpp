@@ -0,0 +1,265 @@
+///////////////////////////////////////////////////////////////////////////////
+// simdmath.cpp
+// ========
+// batched matrix kernels over arrays of transforms, SSE with a scalar fallback
+//
+// With a, b and c the columns of a 3x3 matrix, its inverse transpose has
+// the columns b x c, c x a and a x b, divided by the determinant
+// a . (b x c). That needs six cross products and one reciprocal instead of
+// a general inverse. The batched kernel transposes four matrices into
+// structure-of-arrays registers, so each SSE lane handles one matrix.
+//
+// Matrix products are written as column combinations: column j of a * b is
+// the columns of a weighted by the components of column j of b. With AVX,
+// two result columns share one 256-bit register.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "simdmath.h"
+
+#include <cmath>
+
+#ifdef SIMDMATH_AVX
+#include <immintrin.h>
+#elif defined(SIMDMATH_SSE)
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+	// Relative tolerance of the uniform scale test
+	const float UNIFORM_SCALE_EPSILON = 1e-5f;
+
+	bool IsUniformScale(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, float& scale2)
+	{
+		scale2 = glm::dot(a, a);
+		float tolerance = UNIFORM_SCALE_EPSILON * scale2;
+
+		return std::fabs(glm::dot(b, b) - scale2) <= tolerance
+			&& std::fabs(glm::dot(c, c) - scale2) <= tolerance
+			&& std::fabs(glm::dot(a, b)) <= tolerance
+			&& std::fabs(glm::dot(b, c)) <= tolerance
+			&& std::fabs(glm::dot(c, a)) <= tolerance
+			&& scale2 > 0.0f;
+	}
+}
+
+namespace SimdMath
+{
+	NormalMatrix ComputeNormalMatrix(const glm::mat4& model)
+	{
+		glm::vec3 a(model[0]);
+		glm::vec3 b(model[1]);
+		glm::vec3 c(model[2]);
+
+		NormalMatrix normal;
+
+		// rotation times uniform scale s: the inverse transpose is the matrix over s squared
+		float scale2;
+		if (IsUniformScale(a, b, c, scale2))
+		{
+			float inverseScale2 = 1.0f / scale2;
+			normal.columns[0] = glm::vec4(a * inverseScale2, 0.0f);
+			normal.columns[1] = glm::vec4(b * inverseScale2, 0.0f);
+			normal.columns[2] = glm::vec4(c * inverseScale2, 0.0f);
+			return normal;
+		}
+
+		glm::vec3 bc = glm::cross(b, c);
+		glm::vec3 ca = glm::cross(c, a);
+		glm::vec3 ab = glm::cross(a, b);
+		float det = glm::dot(a, bc);
+		float inverseDet = det != 0.0f ? 1.0f / det : 0.0f;
+
+		normal.columns[0] = glm::vec4(bc * inverseDet, 0.0f);
+		normal.columns[1] = glm::vec4(ca * inverseDet, 0.0f);
+		normal.columns[2] = glm::vec4(ab * inverseDet, 0.0f);
+		return normal;
+	}
+
+	///////////////////////////////////////////////////
+	//	ComputeNormalMatrices(const glm::mat4*, NormalMatrix*, GLuint)
+	//
+	//	models: count transforms
+	//	normals: receives count normal matrices
+	//
+	//	Full groups of four go through SSE; the general
+	//	formula there costs about as much as the uniform
+	//	scale test, so lanes do not branch. The tail uses
+	//	ComputeNormalMatrix().
+	///////////////////////////////////////////////////
+	void ComputeNormalMatrices(const glm::mat4* models, NormalMatrix* normals, GLuint count)
+	{
+		GLuint i = 0;
+
+#ifdef SIMDMATH_SSE
+		for (; i + 4 <= count; i += 4)
+		{
+			const glm::mat4* m = models + i;
+
+			// column k of the four matrices, transposed so each register holds one component
+			__m128 col[3][4];
+			for (int k = 0; k < 3; k++)
+			{
+				col[k][0] = _mm_loadu_ps(&m[0][k][0]);
+				col[k][1] = _mm_loadu_ps(&m[1][k][0]);
+				col[k][2] = _mm_loadu_ps(&m[2][k][0]);
+				col[k][3] = _mm_loadu_ps(&m[3][k][0]);
+				_MM_TRANSPOSE4_PS(col[k][0], col[k][1], col[k][2], col[k][3]);
+			}
+
+			const __m128 ax = col[0][0], ay = col[0][1], az = col[0][2];
+			const __m128 bx = col[1][0], by = col[1][1], bz = col[1][2];
+			const __m128 cx = col[2][0], cy = col[2][1], cz = col[2][2];
+
+			__m128 bcx = _mm_sub_ps(_mm_mul_ps(by, cz), _mm_mul_ps(bz, cy));
+			__m128 bcy = _mm_sub_ps(_mm_mul_ps(bz, cx), _mm_mul_ps(bx, cz));
+			__m128 bcz = _mm_sub_ps(_mm_mul_ps(bx, cy), _mm_mul_ps(by, cx));
+
+			__m128 cax = _mm_sub_ps(_mm_mul_ps(cy, az), _mm_mul_ps(cz, ay));
+			__m128 cay = _mm_sub_ps(_mm_mul_ps(cz, ax), _mm_mul_ps(cx, az));
+			__m128 caz = _mm_sub_ps(_mm_mul_ps(cx, ay), _mm_mul_ps(cy, ax));
+
+			__m128 abx = _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by));
+			__m128 aby = _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz));
+			__m128 abz = _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx));
+
+			__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bcx), _mm_mul_ps(ay, bcy)), _mm_mul_ps(az, bcz));
+
+			// singular matrices get a zero normal matrix, like the scalar path
+			__m128 nonZero = _mm_cmpneq_ps(det, _mm_setzero_ps());
+			__m128 inverseDet = _mm_and_ps(_mm_div_ps(_mm_set1_ps(1.0f), det), nonZero);
+
+			__m128 out[3][4] = {
+				{ _mm_mul_ps(bcx, inverseDet), _mm_mul_ps(bcy, inverseDet), _mm_mul_ps(bcz, inverseDet), _mm_setzero_ps() },
+				{ _mm_mul_ps(cax, inverseDet), _mm_mul_ps(cay, inverseDet), _mm_mul_ps(caz, inverseDet), _mm_setzero_ps() },
+				{ _mm_mul_ps(abx, inverseDet), _mm_mul_ps(aby, inverseDet), _mm_mul_ps(abz, inverseDet), _mm_setzero_ps() }
+			};
+
+			// back to one column per matrix
+			for (int k = 0; k < 3; k++)
+			{
+				_MM_TRANSPOSE4_PS(out[k][0], out[k][1], out[k][2], out[k][3]);
+				for (int j = 0; j < 4; j++)
+					_mm_storeu_ps(&normals[i + j].columns[k][0], out[k][j]);
+			}
+		}
+#endif
+
+		for (; i < count; i++)
+			normals[i] = ComputeNormalMatrix(models[i]);
+	}
+
+	glm::mat4 ComposeTRS(const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+	{
+		const float x = rotation.x, y = rotation.y, z = rotation.z, w = rotation.w;
+		const float xx = x * x, yy = y * y, zz = z * z;
+		const float xy = x * y, xz = x * z, yz = y * z;
+		const float wx = w * x, wy = w * y, wz = w * z;
+
+		glm::mat4 m;
+		m[0] = glm::vec4((1.0f - 2.0f * (yy + zz)) * scale.x, 2.0f * (xy + wz) * scale.x, 2.0f * (xz - wy) * scale.x, 0.0f);
+		m[1] = glm::vec4(2.0f * (xy - wz) * scale.y, (1.0f - 2.0f * (xx + zz)) * scale.y, 2.0f * (yz + wx) * scale.y, 0.0f);
+		m[2] = glm::vec4(2.0f * (xz + wy) * scale.z, 2.0f * (yz - wx) * scale.z, (1.0f - 2.0f * (xx + yy)) * scale.z, 0.0f);
+		m[3] = glm::vec4(translation, 1.0f);
+		return m;
+	}
+
+	///////////////////////////////////////////////////
+	//	MultiplyMat4(const glm::mat4*, const glm::mat4*, glm::mat4*, GLuint)
+	//
+	//	a, b: count left and right operands
+	//	out: receives count products
+	///////////////////////////////////////////////////
+	void MultiplyMat4(const glm::mat4* a, const glm::mat4* b, glm::mat4* out, GLuint count)
+	{
+		for (GLuint i = 0; i < count; i++)
+		{
+#if defined(SIMDMATH_AVX)
+			const __m256 a0 = _mm256_broadcast_ps((const __m128*)&a[i][0][0]);
+			const __m256 a1 = _mm256_broadcast_ps((const __m128*)&a[i][1][0]);
+			const __m256 a2 = _mm256_broadcast_ps((const __m128*)&a[i][2][0]);
+			const __m256 a3 = _mm256_broadcast_ps((const __m128*)&a[i][3][0]);
+
+			for (int j = 0; j < 4; j += 2)
+			{
+				__m256 bj = _mm256_loadu_ps(&b[i][j][0]);
+				__m256 r = _mm256_mul_ps(a0, _mm256_permute_ps(bj, 0x00));
+				r = _mm256_add_ps(r, _mm256_mul_ps(a1, _mm256_permute_ps(bj, 0x55)));
+				r = _mm256_add_ps(r, _mm256_mul_ps(a2, _mm256_permute_ps(bj, 0xAA)));
+				r = _mm256_add_ps(r, _mm256_mul_ps(a3, _mm256_permute_ps(bj, 0xFF)));
+				_mm256_storeu_ps(&out[i][j][0], r);
+			}
+#elif defined(SIMDMATH_SSE)
+			const __m128 a0 = _mm_loadu_ps(&a[i][0][0]);
+			const __m128 a1 = _mm_loadu_ps(&a[i][1][0]);
+			const __m128 a2 = _mm_loadu_ps(&a[i][2][0]);
+			const __m128 a3 = _mm_loadu_ps(&a[i][3][0]);
+
+			for (int j = 0; j < 4; j++)
+			{
+				__m128 bj = _mm_loadu_ps(&b[i][j][0]);
+				__m128 r = _mm_mul_ps(a0, _mm_shuffle_ps(bj, bj, 0x00));
+				r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_shuffle_ps(bj, bj, 0x55)));
+				r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_shuffle_ps(bj, bj, 0xAA)));
+				r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_shuffle_ps(bj, bj, 0xFF)));
+				_mm_storeu_ps(&out[i][j][0], r);
+			}
+#else
+			out[i] = a[i] * b[i];
+#endif
+		}
+	}
+
+	///////////////////////////////////////////////////
+	//	MultiplyAffine(const glm::mat4*, const glm::mat4*, glm::mat4*, GLuint)
+	//
+	//	a, b: count affine left and right operands
+	//	out: receives count affine products
+	//
+	//	The first three columns of b have w = 0, so the
+	//	translation column of a only reaches column 3
+	///////////////////////////////////////////////////
+	void MultiplyAffine(const glm::mat4* a, const glm::mat4* b, glm::mat4* out, GLuint count)
+	{
+		for (GLuint i = 0; i < count; i++)
+		{
+#if defined(SIMDMATH_AVX)
+			const __m256 a0 = _mm256_broadcast_ps((const __m128*)&a[i][0][0]);
+			const __m256 a1 = _mm256_broadcast_ps((const __m128*)&a[i][1][0]);
+			const __m256 a2 = _mm256_broadcast_ps((const __m128*)&a[i][2][0]);
+			// translation in the upper lane only, which holds column 3
+			const __m256 a3 = _mm256_insertf128_ps(_mm256_setzero_ps(), _mm_loadu_ps(&a[i][3][0]), 1);
+
+			__m256 b01 = _mm256_loadu_ps(&b[i][0][0]);
+			__m256 r01 = _mm256_mul_ps(a0, _mm256_permute_ps(b01, 0x00));
+			r01 = _mm256_add_ps(r01, _mm256_mul_ps(a1, _mm256_permute_ps(b01, 0x55)));
+			r01 = _mm256_add_ps(r01, _mm256_mul_ps(a2, _mm256_permute_ps(b01, 0xAA)));
+			_mm256_storeu_ps(&out[i][0][0], r01);
+
+			__m256 b23 = _mm256_loadu_ps(&b[i][2][0]);
+			__m256 r23 = _mm256_mul_ps(a0, _mm256_permute_ps(b23, 0x00));
+			r23 = _mm256_add_ps(r23, _mm256_mul_ps(a1, _mm256_permute_ps(b23, 0x55)));
+			r23 = _mm256_add_ps(r23, _mm256_mul_ps(a2, _mm256_permute_ps(b23, 0xAA)));
+			r23 = _mm256_add_ps(r23, a3);
+			_mm256_storeu_ps(&out[i][2][0], r23);
+#elif defined(SIMDMATH_SSE)
+			const __m128 a0 = _mm_loadu_ps(&a[i][0][0]);
+			const __m128 a1 = _mm_loadu_ps(&a[i][1][0]);
+			const __m128 a2 = _mm_loadu_ps(&a[i][2][0]);
+
+			for (int j = 0; j < 4; j++)
+			{
+				__m128 bj = _mm_loadu_ps(&b[i][j][0]);
+				__m128 r = _mm_mul_ps(a0, _mm_shuffle_ps(bj, bj, 0x00));
+				r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_shuffle_ps(bj, bj, 0x55)));
+				r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_shuffle_ps(bj, bj, 0xAA)));
+				if (j == 3)
+					r = _mm_add_ps(r, _mm_loadu_ps(&a[i][3][0]));
+				_mm_storeu_ps(&out[i][j][0], r);
+			}
+#else
+			out[i] = a[i] * b[i];
+#endif
+		}
+	}
+}
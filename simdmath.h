@@ -0,0 +1,49 @@
+///////////////////////////////////////////////////////////////////////////////
+// simdmath.h
+// ========
+// batched matrix kernels over arrays of transforms, SSE with a scalar fallback
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define SIMDMATH_SSE 1
+#endif
+
+// Enabled by /arch:AVX (MSVC) or -mavx
+#if defined(SIMDMATH_SSE) && defined(__AVX__)
+#define SIMDMATH_AVX 1
+#endif
+
+// Inverse transpose of a model matrix's upper 3x3, as the three vec4 columns
+// std430 stores for a mat3
+struct NormalMatrix
+{
+	glm::vec4 columns[3];
+};
+
+namespace SimdMath
+{
+	// Normal matrix of one transform. Rotations with a uniform scale take a
+	// shortcut that only rescales the matrix.
+	NormalMatrix ComputeNormalMatrix(const glm::mat4& model);
+
+	// Normal matrices of count transforms, four at a time
+	void ComputeNormalMatrices(const glm::mat4* models, NormalMatrix* normals, GLuint count);
+
+	// translate(translation) * mat4_cast(rotation) * scale(scale), written directly from
+	// the unit quaternion's rotation columns without any 4x4 multiply
+	glm::mat4 ComposeTRS(const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale);
+
+	// out[i] = a[i] * b[i] for count pairs. out must not alias a.
+	void MultiplyMat4(const glm::mat4* a, const glm::mat4* b, glm::mat4* out, GLuint count);
+
+	// Same product for affine matrices, whose last row is (0, 0, 0, 1); skips the work
+	// that row would contribute. out must not alias a.
+	void MultiplyAffine(const glm::mat4* a, const glm::mat4* b, glm::mat4* out, GLuint count);
+}
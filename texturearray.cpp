@@ -0,0 +1,156 @@
+///////////////////////////////////////////////////////////////////////////////
+// texturearray.cpp
+// ========
+// every material texture as a layer of one GL_TEXTURE_2D_ARRAY
+//
+// A texture array needs layers of one size and format, so every image is
+// expanded to RGBA and bilinearly resampled to a common size on load.
+// Objects then choose their texture with a layer index in their object
+// data instead of a bind, so objects with different textures can share
+// an instanced draw or a multi-draw.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "texturearray.h"
+#include "glstate.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+	struct Image
+	{
+		unsigned char* pixels;
+		int width;
+		int height;
+		int channels;
+	};
+
+	// RGBA of a pixel of any channel count; gray and gray-alpha images repeat gray
+	void Texel(const Image& image, int x, int y, float rgba[4])
+	{
+		const unsigned char* p = image.pixels + (y * image.width + x) * image.channels;
+		switch (image.channels)
+		{
+		case 1: rgba[0] = rgba[1] = rgba[2] = p[0]; rgba[3] = 255.0f; break;
+		case 2: rgba[0] = rgba[1] = rgba[2] = p[0]; rgba[3] = p[1]; break;
+		case 3: rgba[0] = p[0]; rgba[1] = p[1]; rgba[2] = p[2]; rgba[3] = 255.0f; break;
+		default: rgba[0] = p[0]; rgba[1] = p[1]; rgba[2] = p[2]; rgba[3] = p[3]; break;
+		}
+	}
+
+	///////////////////////////////////////////////////
+	//	Resample(const Image&, int, int, std::vector<unsigned char>&)
+	//
+	//	Bilinear resampling into RGBA8 rows, bottom row first
+	//	as OpenGL expects, since images load top row first
+	///////////////////////////////////////////////////
+	void Resample(const Image& image, int width, int height, std::vector<unsigned char>& out)
+	{
+		out.resize((size_t)width * height * 4);
+
+		for (int y = 0; y < height; y++)
+		{
+			float sourceY = std::min(std::max((y + 0.5f) * image.height / height - 0.5f, 0.0f), (float)(image.height - 1));
+			int y0 = (int)sourceY;
+			int y1 = std::min(y0 + 1, image.height - 1);
+			float fy = sourceY - y0;
+
+			unsigned char* row = &out[(size_t)(height - 1 - y) * width * 4];
+			for (int x = 0; x < width; x++)
+			{
+				float sourceX = std::min(std::max((x + 0.5f) * image.width / width - 0.5f, 0.0f), (float)(image.width - 1));
+				int x0 = (int)sourceX;
+				int x1 = std::min(x0 + 1, image.width - 1);
+				float fx = sourceX - x0;
+
+				float a[4], b[4], c[4], d[4];
+				Texel(image, x0, y0, a);
+				Texel(image, x1, y0, b);
+				Texel(image, x0, y1, c);
+				Texel(image, x1, y1, d);
+				for (int i = 0; i < 4; i++)
+				{
+					float top = a[i] + (b[i] - a[i]) * fx;
+					float bottom = c[i] + (d[i] - c[i]) * fx;
+					row[x * 4 + i] = (unsigned char)(top + (bottom - top) * fy + 0.5f);
+				}
+			}
+		}
+	}
+}
+
+///////////////////////////////////////////////////
+//	Create(const std::vector<const char*>&, GLsizei)
+//
+//	filenames: one image per layer
+//	maxSize: largest layer width and height
+//
+//	Fails, naming the file, if any image cannot be loaded
+///////////////////////////////////////////////////
+bool TextureArray::Create(const std::vector<const char*>& filenames, GLsizei maxSize)
+{
+	Destroy();
+
+	std::vector<Image> images;
+	bool loaded = true;
+	for (const char* filename : filenames)
+	{
+		Image image;
+		image.pixels = stbi_load(filename, &image.width, &image.height, &image.channels, 0);
+		if (!image.pixels)
+		{
+			std::cout << "Failed to load texture " << filename << std::endl;
+			loaded = false;
+			break;
+		}
+		images.push_back(image);
+		width = std::max(width, (GLsizei)image.width);
+		height = std::max(height, (GLsizei)image.height);
+	}
+
+	if (loaded && !images.empty())
+	{
+		width = std::min(width, maxSize);
+		height = std::min(height, maxSize);
+		nLayers = (GLuint)images.size();
+
+		GLsizei levels = 1;
+		while ((std::max(width, height) >> levels) > 0)
+			levels++;
+
+		glGenTextures(1, &texture);
+		gGLState.BindTexture(GL_TEXTURE_2D_ARRAY, texture);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_RGBA8, width, height, nLayers);
+
+		std::vector<unsigned char> pixels;
+		for (GLuint layer = 0; layer < nLayers; layer++)
+		{
+			Resample(images[layer], width, height, pixels);
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+		}
+
+		// same sampling as the separate textures had
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+		gGLState.BindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	}
+
+	for (Image& image : images)
+		stbi_image_free(image.pixels);
+
+	return loaded && texture != 0;
+}
+
+void TextureArray::Destroy()
+{
+	gGLState.DeleteTextures(1, &texture);
+	texture = 0;
+	width = height = 0;
+	nLayers = 0;
+}
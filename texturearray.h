@@ -0,0 +1,26 @@
+///////////////////////////////////////////////////////////////////////////////
+// texturearray.h
+// ========
+// every material texture as a layer of one GL_TEXTURE_2D_ARRAY
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <vector>
+
+class TextureArray
+{
+public:
+	GLuint texture = 0;
+	GLsizei width = 0;		// Size of every layer
+	GLsizei height = 0;
+	GLuint nLayers = 0;
+
+public:
+	// Load the images, resample them to the size of the largest, capped at maxSize, and
+	// upload them as layers with mipmaps; layer i is filenames[i]
+	bool Create(const std::vector<const char*>& filenames, GLsizei maxSize);
+	void Destroy();
+};
@@ -0,0 +1,53 @@
+///////////////////////////////////////////////////////////////////////////////
+// triplebuffer.h
+// ========
+// lock-free hand-off of the newest value from one thread to another
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <atomic>
+
+// Three copies of T: the writer fills one, the reader reads another, and the third
+// holds the newest published value. Each side only ever swaps its own copy with the
+// third one, in a single atomic exchange, so neither waits for the other and a slow
+// reader simply skips the values it missed. One writer and one reader thread.
+template<typename T>
+class TripleBuffer
+{
+public:
+	// The writer's copy, to fill before Publish()
+	T& Back() { return mSlots[mBack]; }
+
+	// Make the writer's copy the newest value and take the spare one to write next
+	void Publish()
+	{
+		GLuint previous = mMiddle.exchange(mBack | FRESH, std::memory_order_acq_rel);
+		mBack = previous & INDEX;
+	}
+
+	// Take the newest value if one was published since the last call; returns whether
+	// Front() changed
+	bool Acquire()
+	{
+		if (!(mMiddle.load(std::memory_order_relaxed) & FRESH))
+			return false;
+		GLuint previous = mMiddle.exchange(mFront, std::memory_order_acq_rel);
+		mFront = previous & INDEX;
+		return true;
+	}
+
+	// The reader's copy, stays the same until the next Acquire()
+	const T& Front() const { return mSlots[mFront]; }
+
+private:
+	static const GLuint INDEX = 3;	// Slot bits of mMiddle
+	static const GLuint FRESH = 4;	// Set while mMiddle holds a value the reader has not taken
+
+	T mSlots[3];
+	GLuint mBack = 0;				// Only touched by the writer
+	std::atomic<GLuint> mMiddle{ 1 };
+	GLuint mFront = 2;				// Only touched by the reader
+};